@@ -5,6 +5,7 @@
 #include <iostream>
 #include <vector>
 #include <climits>
+#include <limits>
 #include <map>
 #include <algorithm>
 #include <fstream>
@@ -36,6 +37,7 @@ namespace Ba {
 		int spin() const { return spin_;};
 		double time() const { return time_;};
 		int n() const { return *ptr_;};
+		int* ptr() const { return ptr_;};
 	private:
 		int site_;
 		int spin_;
@@ -46,46 +48,64 @@ namespace Ba {
 	bool operator==(Operator const& lhs, Operator const& rhs) {
 		return lhs.site() == rhs.site() && lhs.spin() == rhs.spin() && lhs.time() == rhs.time();
 	}
-	
-	struct Bath {
-		/** 
-		* 
-		* struct GreenIterator
-		* 
-		* Parameters :	opBegin : the operator which is at the beginning of the Green function matrix
-		*				opEnd : the after last operator of the row 
-		*				opDagg : the dagger operator (the rwo of the green's function matrix
-		*				value : pointer on the value of the matrix at Green[opBegin,opDagg]
-		* 
-		* Description :
-		*	This is a custom iterator over a Green's function matrix.
-		*	This allow iteration over the Green function matrix in C++ standard while being able to know which component we are looking at (which operators are involved)
-		*	opEnd allows the program to know when to go to the next row when reaching the last operators of the list to avoid Segmentation error or Access Violation.
-		* 
-		*/
-		struct GreenIterator {
-			GreenIterator(Operator const* opBegin, Operator const* opEnd, Operator const* opDagg, double const* value) : opBegin_(opBegin), opEnd_(opEnd), opR_(opBegin), opL_(opDagg), value_(value) {};
-			Operator const& opR() const { return *opR_;};
-			Operator const& opL() const { return *opL_;};			
-			double value() const { return *value_;};
-			
-			GreenIterator& operator++() { ++value_; if(++opR_ == opEnd_) { opR_ = opBegin_; ++opL_;}; return *this;}; 
-			bool operator!=(GreenIterator const& other) const { return value_ != other.value_;};
-		private:
-			Operator const* const opBegin_; Operator const* const opEnd_;
-			Operator const* opR_; Operator const* opL_; double const* value_;
-		};
+	/** 
+	* 
+	* struct Operators
+	* 
+	* Description :
+	*	Storage of the operators of one side (rows or columns) of the bath matrix as a structure of arrays.
+	*	Sites, spins and times are kept in separate contiguous arrays, so that a whole row or column of the hybridisation matrix
+	*	can be computed in a single pass by the link (see Link::column and Link::row).
+	* 
+	*/
+	struct Operators {
+		std::size_t size() const { return time_.size();};
 		
-		Bath() : swapSign_(1), B_(0), det_(1.) {};
+		int const* site() const { return site_.data();};
+		int const* spin() const { return spin_.data();};
+		double const* time() const { return time_.data();};
+		
+		Operator operator[](std::size_t n) const { return Operator(site_[n], spin_[n], time_[n], ptr_[n]);};
+		Operator back() const { return (*this)[size() - 1];};
+		
+		void push_back(Operator const& op) { 
+			site_.push_back(op.site()); spin_.push_back(op.spin()); time_.push_back(op.time()); ptr_.push_back(op.ptr());
+		};
+		void pop_back() { 
+			site_.pop_back(); spin_.pop_back(); time_.pop_back(); ptr_.pop_back();
+		};
+		void set(std::size_t n, Operator const& op) { 
+			site_[n] = op.site(); spin_[n] = op.spin(); time_[n] = op.time(); ptr_[n] = op.ptr();
+		};
+		/* Returns the position of op, or size() if it is not stored */
+		std::size_t find(Operator const& op) const {
+			std::size_t n = 0; 
+			while(n != size() && !(time_[n] == op.time() && site_[n] == op.site() && spin_[n] == op.spin())) ++n;
+			return n;
+		};
+	private:
+		std::vector<int> site_;
+		std::vector<int> spin_;
+		std::vector<double> time_;
+		std::vector<int*> ptr_;
+	};
+	
+	/** 
+	* 
+	* struct Block
+	* 
+	* Description :
+	*	Inverse B_ of the hybridisation matrix of the operators of one block of flavors (see Bath), with its determinant. 
+	*	The determinant is kept as log|det| and a sign, so that it neither overflows nor underflows at large expansion orders.
+	*	It is updated with the Shermann Morisson formula when a pair of operators is inserted or erased, or when an operator is moved.
+	* 
+	*/
+	struct Block {
+		Block() : swapSign_(1), B_(0), logDet_(.0), signDet_(1), drift_(.0), normB_(.0) {};
 		
 		void add(int site, int spin, double time, int* ptr) { spin ? opsL_.push_back(Operator(site, spin, time, ptr)) : opsR_.push_back(Operator(site, spin, time, ptr));};
 		void addDagg(int site, int spin, double time, int* ptr) { spin ? opsR_.push_back(Operator(site, spin, time, ptr)) : opsL_.push_back(Operator(site, spin, time, ptr));};
 		
-		GreenIterator begin() const { return B_ ? GreenIterator(opsR_.data(), opsR_.data() + opsR_.size(), opsL_.data(), B_->data()) : GreenIterator(0, 0, 0, 0);};
-		GreenIterator end() const { return B_ ? GreenIterator(0, 0, 0, B_->data() + opsR_.size()*opsL_.size()) : GreenIterator(0, 0, 0, 0);};
-		
-		//template<typename T, typename L> Bath(int spin, std::vector<Tr*>::const_iterator begin, std::vector<Tr*>::const_iterator end, L const& link) {
-		//};
 		/** 
 		* 
 		* template<typename L> double insert(int site, double time, int* ptr, double timeDagg, int* ptrDagg, L const& link)
@@ -101,10 +121,28 @@ namespace Ba {
 		*
 		* Description: 
 		*   Computes G[op_time,op_timeDagg] in the new configuration if we added a site. This operation doesn't affect the Green's matrix. 
-		*	The value will be used to determine the accept probability
+		*	The value will be used to determine the accept probability. This is insertBound() followed by insertRatio().
 		* 
 		*/
 		template<typename L> double insert(int site, int spin, double time, int* ptr, double timeDagg, int* ptrDagg, L const& link) {
+			insertBound(site, spin, time, ptr, timeDagg, ptrDagg, link);
+			return insertRatio();
+		}; 
+		/** 
+		* 
+		* template<typename L> double insertBound(int site, int spin, double time, int* ptr, double timeDagg, int* ptrDagg, L const& link)
+		* 
+		* Parameters :	the same as insert()
+		* 
+		* Return value : Returns the log of an upper bound of |G[op_time,op_timeDagg]| in the new configuration
+		*
+		* Description: 
+		*   First stage of insert(). Computes the new row w and column u of the hybridisation matrix, which only takes O(N) operations.
+		*	Since G = link(opL, opR) - w.B u, |G| <= |link(opL, opR)| + |w||u||B|_F. The Frobenius norm of B is kept up to date by the updates of B, 
+		*	in the same pass over the matrix. If the Metropolis test fails even with this bound, the O(N^2) part (insertRatio()) can be skipped.
+		* 
+		*/
+		template<typename L> double insertBound(int site, int spin, double time, int* ptr, double timeDagg, int* ptrDagg, L const& link) {
 			opR_ = Operator(site, spin, time, ptr); 
 			opL_ = Operator(site, spin, timeDagg, ptrDagg);
 			if(spin) std::swap(opR_, opL_);
@@ -112,22 +150,47 @@ namespace Ba {
 			int const N = opsL_.size();
 			val_ = link(opL_, opR_);
 			
+			if(N) {
+				col_.resize(N); vec_.resize(N);
+				link.column(opsL_, opR_, col_.data());
+				link.row(opL_, opsR_, vec_.data());
+				
+				int const inc = 1;
+				
+				//Squared norms are cheaper than dnrm2 and cannot overflow here, the relative margin covers the rounding errors
+				double const norms = ddot_(&N, vec_.data(), &inc, vec_.data(), &inc)*ddot_(&N, col_.data(), &inc, col_.data(), &inc)*normB_;
+				return std::log((std::abs(val_) + std::sqrt(norms))*(1. + 1.e-8));
+			}
+			
+			return std::log(std::abs(val_));
+		};
+		/** 
+		* 
+		* double insertRatio()
+		* 
+		* Return value : Returns log(|G[op_time,op_timeDagg]|) in the new configuration
+		*
+		* Description: 
+		*   Second stage of insert(), after insertBound(). Computes B u and G = link(opL, opR) - w.B u.
+		* 
+		*/
+		double insertRatio() {
+			int const N = opsL_.size();
+			
 			if(N) {  
-				Bv_.resize(N); vec_.resize(N);
-				for(int n = 0; n < N; ++n) vec_[n] = link(opsL_[n], opR_);
+				Bv_.resize(N);
 				
 				char const no = 'n';
 				int const inc = 1;
 				double const zero = .0;
 				double const one = 1.;
-				dgemv_(&no, &N, &N, &one, B_->data(), &N, vec_.data(), &inc, &zero, Bv_.data(), &inc);
+				dgemv_(&no, &N, &N, &one, B_->data(), &N, col_.data(), &inc, &zero, Bv_.data(), &inc);
 				
-				for(int n = 0; n < N; ++n) vec_[n] = link(opL_, opsR_[n]);			
 				val_ -= ddot_(&N, vec_.data(), &inc, Bv_.data(), &inc);	
 			}
 			
 			return std::log(std::abs(val_));
-		}; 
+		};
 		/* 
 		* int acceptInsert()
 		* 
@@ -158,8 +221,9 @@ namespace Ba {
 				dgemv_(&yes, &N, &N, &fact, B_->data(), &N, vec_.data(), &inc, &zero, hBTilde.data(), &inc);
 				dger_(&N, &N, &one, Bv_.data(), &inc, hBTilde.data(), &inc, B_->data(), &N);
 				
+				normB_ = .0;
 				for(int n = 0; n < N; ++n) 
-					dcopy_(&N, B_->data(0, n), &inc, temp->data(0, n), &inc);
+					normB_ += axpyNorm(N, .0, Bv_.data(), B_->data(0, n), temp->data(0, n));
 				
 				fact = -1./val_;
 				dscal_(&N, &fact, Bv_.data(), &inc); 
@@ -168,13 +232,15 @@ namespace Ba {
 				double const minus = -1.;
 				dscal_(&N, &minus, hBTilde.data(), &inc); 
 				dcopy_(&N, hBTilde.data(), &inc, temp->data(N, 0), &newN); 
-			}
+				
+				normB_ += ddot_(&N, Bv_.data(), &inc, Bv_.data(), &inc) + ddot_(&N, hBTilde.data(), &inc, hBTilde.data(), &inc);
+			} else 
+				normB_ = .0;
+			normB_ += temp->at(N, N)*temp->at(N, N);
 			
 			delete B_; B_ = temp;
 			
-			det_ *= val_;
-			
-			return val_ > .0 ? 1 : -1;
+			return update();
 		};
 		/** 
 		* 
@@ -195,8 +261,8 @@ namespace Ba {
 			Operator dummyL(site, spin, timeDagg, 0);
 			if(spin) std::swap(dummyR, dummyL);
 			   
-			posR_ = 0; while(static_cast<std::size_t>(posR_) != opsR_.size() && !(opsR_[posR_] == dummyR)) ++posR_;
-			posL_ = 0; while(static_cast<std::size_t>(posL_) != opsL_.size() && !(opsL_[posL_] == dummyL)) ++posL_;
+			posR_ = opsR_.find(dummyR);
+			posL_ = opsL_.find(dummyL);
 			
 			//Test if pos = size 
 
@@ -220,29 +286,111 @@ namespace Ba {
 				
 				if(posL_ != newN) { 
 					dswap_(&N, B_->data(0, newN), &inc, B_->data(0, posL_), &inc); swapSign_ *= -1; 
-					opsL_[posL_] = opsL_.back(); 					 
+					opsL_.set(posL_, opsL_.back()); 					 
 				}
 				if(posR_ != newN) { 
 					dswap_(&N, B_->data(newN, 0), &N, B_->data(posR_, 0), &N); swapSign_ *= -1;
-					opsR_[posR_] = opsR_.back(); 
+					opsR_.set(posR_, opsR_.back()); 
 				} 
 				
-				for(int n = 0; n < newN; ++n) 
-					dcopy_(&newN, B_->data(0, n), &inc, temp->data(0, n), &inc);
-				
+				//Rank one update column by column, the norm is summed in the same pass
 				double const fact = -1./val_;
-				dger_(&newN, &newN, &fact, B_->data(0, newN), &inc, B_->data(newN, 0), &N, temp->data(), &newN);
+				normB_ = .0;
+				for(int n = 0; n < newN; ++n) 
+					normB_ += axpyNorm(newN, fact*B_->at(newN, n), B_->data(0, newN), B_->data(0, n), temp->data(0, n));
 				
 				delete B_; B_ = temp;
 			} else {
-				delete B_; B_ = 0;
+				delete B_; B_ = 0; normB_ = .0;
 			}
 			
 			opsL_.pop_back(); opsR_.pop_back();
 			
-			det_ *= val_;
+			return update();
+		};
+		/** 
+		* 
+		* template<typename L> double shift(int site, int spin, int type, double time, double newTime, int* ptr, L const& link)
+		* 
+		* Parameters :	site : site of the operator
+		*				spin : spin of the operator
+		*				type : type of the operator (1 for a creation and 0 for an annihilation operator)
+		*				time : current time of the operator
+		*				newTime : proposed time of the operator
+		*				ptr : pointer to the operator (only used to create the Operator)
+		*				link : link function to get the hybridization function between sites
+		* 
+		* Return value : Returns log(|det(M')/det(M)|), M' being the hybridisation matrix with the operator at newTime
+		*
+		* Description: 
+		*   Moving an operator replaces a column (opsR_) or a row (opsL_) of the hybridisation matrix M, whose inverse is B_.
+		*	The determinant ratio is then the new column times the corresponding row of B_ (or the new row times the corresponding column of B_).
+		*	This operation doesn't affect the Green's matrix.
+		*/
+		template<typename L> double shift(int site, int spin, int type, double time, double newTime, int* ptr, L const& link) {
+			int const N = opsL_.size();
+			int const inc = 1;
+			
+			shiftR_ = type == spin;
+			vec_.resize(N);
+			
+			if(shiftR_) {
+				opR_ = Operator(site, spin, newTime, ptr);
+				posR_ = opsR_.find(Operator(site, spin, time, 0));
+				link.column(opsL_, opR_, vec_.data());
+				val_ = ddot_(&N, B_->data(posR_, 0), &N, vec_.data(), &inc);
+			} else {
+				opL_ = Operator(site, spin, newTime, ptr);
+				posL_ = opsL_.find(Operator(site, spin, time, 0));
+				link.row(opL_, opsR_, vec_.data());
+				val_ = ddot_(&N, B_->data(0, posL_), &inc, vec_.data(), &inc);
+			}
 			
-			return val_ > .0 ? 1 : -1;
+			return std::log(std::abs(val_));
+		};
+		/* 
+		* int acceptShift()
+		* 
+		* Return value : The sign of the determinant ratio
+		*
+		* Description: 
+		*  	This function accepts the move of an operator. The column (or row) replacement is a rank one update of M, 
+		*	so that B_ is updated in place with the shermann morisson formula : B' = B - (B u - e)(e^T B)/val for a new column u (and the transposed for a new row)
+		*/
+		int acceptShift() {
+			int const N = opsL_.size();
+			
+			Bv_.resize(N); hB_.resize(N);
+			
+			int const inc = 1;
+			double const zero = .0;
+			double const one = 1.;
+			double const fact = -1./val_;
+			//The rank one update x y^T is done column by column, so that the norm is summed in the same pass
+			double const* x; double const* y;
+			if(shiftR_) {
+				char const no = 'n';
+				dgemv_(&no, &N, &N, &one, B_->data(), &N, vec_.data(), &inc, &zero, Bv_.data(), &inc);
+				Bv_[posR_] -= 1.;
+				dcopy_(&N, B_->data(posR_, 0), &N, hB_.data(), &inc);
+				x = Bv_.data(); y = hB_.data();
+				
+				opsR_.set(posR_, opR_);
+			} else {
+				char const yes = 't';
+				dgemv_(&yes, &N, &N, &one, B_->data(), &N, vec_.data(), &inc, &zero, Bv_.data(), &inc);
+				Bv_[posL_] -= 1.;
+				dcopy_(&N, B_->data(0, posL_), &inc, hB_.data(), &inc);
+				x = hB_.data(); y = Bv_.data();
+				
+				opsL_.set(posL_, opL_);
+			}
+			
+			normB_ = .0;
+			for(int n = 0; n < N; ++n) 
+				normB_ += axpyNorm(N, fact*y[n], x, B_->data(0, n), B_->data(0, n));
+			
+			return update();
 		};
 		/* 
 		* template<class L>
@@ -251,58 +399,201 @@ namespace Ba {
 		* Return value : The sign of the matrix determinant
 		*
 		* Description: 
-		*  	This function rebuilds the Green function Matrix from the link function. It also computes the determinant of the matrix
+		*  	This function rebuilds the Green function Matrix from the link function, with a LU factorisation of the hybridisation matrix 
+		*	followed by its inversion in place. log|det| and the sign of the determinant are read from the diagonal of U and from the pivots.
+		*	The workspace is kept from one call to the next. The relative difference (Frobenius norm) between the rebuilt matrix and the 
+		*	updated one it replaces is kept as a measure of the numerical error of the updates (see drift()).
+		*	A singular matrix (a configuration of weight zero, for example a flip proposal) gives log|det| = -inf and leaves B_ as it was.
 		*/
 		template<class L>
 		int rebuild(L const& link) {			
 			int const N = opsL_.size();
-			det_ = swapSign_;
+			logDet_ = .0; signDet_ = swapSign_; drift_ = .0; normB_ = .0;
 			
 			if(N) {
-				if(!B_) B_ = new Matrix(N, N);
-				
-				Matrix toInvert(N, N);
+				int const size = N*N;
+				lu_.resize(size); ipiv_.resize(N);
 				
 				for(int j = 0; j < N; ++j) 					
-					for(int i = 0; i < N; ++i) 
-						toInvert.at(i,j) = link(opsL_[i], opsR_[j]);
+					link.column(opsL_, opsR_[j], lu_.data() + j*N);
 				
-				int const inc0 = 0; int const inc1 = 1;
-				int const diagInc = N + 1; int const size = N*N;
-				double const zero = .0; double const one = 1.;
+				int info;
+				dgetrf_(&N, &N, lu_.data(), &N, ipiv_.data(), &info);
+				if(info < 0) throw std::runtime_error("Ba::Block::rebuild: dgetrf failed");
+				if(info > 0) {
+					logDet_ = -std::numeric_limits<double>::infinity();
+					return signDet_;
+				}
+				
+				for(int i = 0; i < N; ++i) {
+					double const u = lu_[i + N*i];
+					logDet_ += std::log(std::abs(u));
+					if((u < .0) != (ipiv_[i] != i + 1)) signDet_ = -signDet_;
+				}
 				
-				dcopy_(&size, &zero, &inc0, B_->data(), &inc1);
-				dcopy_(&N, &one, &inc0, B_->data(), &diagInc);
+				//64*N is at least the optimal size for the block sizes of the reference Lapack and of OpenBlas
+				int const lwork = 64*N; work_.resize(lwork);
+				dgetri_(&N, lu_.data(), &N, ipiv_.data(), work_.data(), &lwork, &info);
+				if(info) throw std::runtime_error("Ba::Block::rebuild: dgetri failed");
 				
-				int ipiv[N]; int info;
-				dgesv_(&N, &N, toInvert.data(), &N, ipiv, B_->data(), &N, &info);
+				double diff = .0;
+				if(B_) {
+					for(int n = 0; n < size; ++n) diff += (lu_[n] - B_->data()[n])*(lu_[n] - B_->data()[n]);
+				} else 
+					B_ = new Matrix(N, N);
 				
-				for(int i = 0; i < N; ++i) 
-					det_ *= (ipiv[i] != i + 1 ? -toInvert.at(i, i) : toInvert.at(i, i));
+				int const inc = 1;
+				dcopy_(&size, lu_.data(), &inc, B_->data(), &inc);
+				normB_ = ddot_(&size, B_->data(), &inc, B_->data(), &inc);
+				drift_ = normB_ > .0 ? std::sqrt(diff/normB_) : .0;
 			}
 			
-			return det_ > .0 ? 1 : -1;
+			return signDet_;
 		};
 		
-		double det() { return det_;};
+		double logDet() const { return logDet_;};
+		int sign() const { return signDet_;};
+		double det() const { return signDet_*std::exp(logDet_);};
+		double drift() const { return drift_;};
+		std::size_t size() const { return opsL_.size();};
+		
+		/* Operators of the rows and of the columns of B_, and B_ itself (column major, B_[posR + size()*posL]) */
+		Operators const& opsR() const { return opsR_;};
+		Operators const& opsL() const { return opsL_;};
+		double const* data() const { return B_ ? B_->data() : 0;};
 		
-		~Bath() { delete B_;};
+		~Block() { delete B_;};
 	private:
 		int swapSign_;
 		Matrix* B_;
-		double det_;
+		double logDet_;     //log|det| of the hybridisation matrix
+		int signDet_;
+		double drift_;      //Relative difference between B_ rebuilt and updated, at the last rebuild
+		
+		std::vector<double> lu_;
+		std::vector<int> ipiv_;
+		std::vector<double> work_;
 		
 		std::vector<double> Bv_;
 		std::vector<double> vec_;
+		std::vector<double> hB_;
+		std::vector<double> col_;
 		double val_;
+		bool shiftR_;
+		double normB_;      //Squared Frobenius norm of B_
+		
+		/* Adds the determinant ratio val_ of an accepted update to the determinant, and returns its sign */
+		int update() {
+			logDet_ += std::log(std::abs(val_));
+			int const sign = val_ > .0 ? 1 : -1;
+			signDet_ *= sign;
+			return sign;
+		};
+		
+		/* Sets dest = src + alpha*x (dest can be src) and returns the squared norm of dest. Four partial sums, so that the loop is not bound by the latency of the additions */
+		static double axpyNorm(int N, double alpha, double const* x, double const* src, double* dest) {
+			double norm[4] = {.0, .0, .0, .0};
+			int n = 0;
+			for(; n + 4 <= N; n += 4) 
+				for(int k = 0; k < 4; ++k) {
+					dest[n + k] = src[n + k] + alpha*x[n + k];
+					norm[k] += dest[n + k]*dest[n + k];
+				}
+			for(; n < N; ++n) {
+				dest[n] = src[n] + alpha*x[n];
+				norm[0] += dest[n]*dest[n];
+			}
+			return (norm[0] + norm[1]) + (norm[2] + norm[3]);
+		};
 		
 		
 		int posR_; 
 		int posL_;
 		Operator opR_; 
 		Operator opL_;
-		std::vector<Operator> opsR_;
-		std::vector<Operator> opsL_;
+		Operators opsR_;
+		Operators opsL_;
+	};
+	/** 
+	* 
+	* struct Bath
+	* 
+	* Description :
+	*	Hybridisation matrix of all the operators, split into the blocks of flavors (spin*nSite + site) given by the link (see Link::blocks).
+	*	The hybridisation does not connect two different blocks, so that the matrix is block diagonal : every block keeps its own inverse 
+	*	and determinant, and an update only touches the block of its operators. For a normal state, the spins are two blocks of half the size.
+	*	The rows and the columns of a flavor are in the same block, so that grouping them by block permutes the rows and the columns in 
+	*	the same way : the determinant is the product of the determinants of the blocks, sign included.
+	*	The methods are the ones of Block, the accept functions apply to the block of the last proposal.
+	* 
+	*/
+	struct Bath {
+		explicit Bath(std::vector<int> const& blocks) : 
+		nSite_(blocks.size()/2), 
+		blockOf_(blocks), 
+		blocks_(blocks.size() ? *std::max_element(blocks.begin(), blocks.end()) + 1 : 1), 
+		block_(0) {};
+		
+		void add(int site, int spin, double time, int* ptr) { block(site, spin).add(site, spin, time, ptr);};
+		void addDagg(int site, int spin, double time, int* ptr) { block(site, spin).addDagg(site, spin, time, ptr);};
+		
+		template<typename L> double insert(int site, int spin, double time, int* ptr, double timeDagg, int* ptrDagg, L const& link) {
+			return block(site, spin).insert(site, spin, time, ptr, timeDagg, ptrDagg, link);
+		};
+		template<typename L> double insertBound(int site, int spin, double time, int* ptr, double timeDagg, int* ptrDagg, L const& link) {
+			return block(site, spin).insertBound(site, spin, time, ptr, timeDagg, ptrDagg, link);
+		};
+		double insertRatio() { return blocks_[block_].insertRatio();};
+		int acceptInsert() { return blocks_[block_].acceptInsert();};
+		
+		double erase(int site, int spin, double time, double timeDagg) { return block(site, spin).erase(site, spin, time, timeDagg);};
+		int acceptErase() { return blocks_[block_].acceptErase();};
+		
+		template<typename L> double shift(int site, int spin, int type, double time, double newTime, int* ptr, L const& link) {
+			return block(site, spin).shift(site, spin, type, time, newTime, ptr, link);
+		};
+		int acceptShift() { return blocks_[block_].acceptShift();};
+		
+		template<class L>
+		int rebuild(L const& link) {
+			int sign = 1;
+			for(std::vector<Block>::iterator it = blocks_.begin(); it != blocks_.end(); ++it) sign *= it->rebuild(link);
+			return sign;
+		};
+		
+		double logDet() const {
+			double logDet = .0;
+			for(std::vector<Block>::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it) logDet += it->logDet();
+			return logDet;
+		};
+		int sign() const {
+			int sign = 1;
+			for(std::vector<Block>::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it) sign *= it->sign();
+			return sign;
+		};
+		double det() const { return sign()*std::exp(logDet());};
+		/* Largest drift of the blocks at the last rebuild (see Block::rebuild) */
+		double drift() const {
+			double drift = .0;
+			for(std::vector<Block>::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it) drift = std::max(drift, it->drift());
+			return drift;
+		};
+		std::size_t size() const {
+			std::size_t size = 0;
+			for(std::vector<Block>::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it) size += it->size();
+			return size;
+		};
+		
+		/* The Green's function matrix is measured block by block (see Link::measure) */
+		std::size_t blocks() const { return blocks_.size();};
+		Block const& block(std::size_t block) const { return blocks_[block];};
+	private:
+		std::size_t const nSite_;
+		std::vector<int> const blockOf_;    //Block of every flavor
+		std::vector<Block> blocks_;
+		std::size_t block_;                 //Block of the last proposal
+		
+		Block& block(int site, int spin) { return blocks_[block_ = blockOf_[spin*nSite_ + site]];};
 	};
 	
 };
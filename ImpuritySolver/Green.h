@@ -11,15 +11,29 @@
 
 namespace Green {
 	struct Meas {
-		Meas(std::string name, json const& jNumericalParams, Ut::Measurements& measurements) :
+		/** 
+		* 
+		* Meas(std::string name, json const& jNumericalParams, Ut::Measurements& measurements, double* green = 0)
+		* 
+		* Parameters :	name : name of the Green function component
+		*				jNumericalParams : storage of all the numerical parameters of the simulation
+		*				measurements : variable used to store the measurements, used for output
+		*				green : storage of size(jNumericalParams) doubles for the accumulation, owned by the caller. Allocated here if null.
+		* 
+		*/
+		Meas(std::string name, json const& jNumericalParams, Ut::Measurements& measurements, double* green = 0) :
 		name_(name),
 		beta_(jNumericalParams["beta"]),
-		nMatG_(beta_*jNumericalParams["EGreen"].get<double>()/(2*M_PI) + 1), 
+		nMatG_(nMat(jNumericalParams)), 
 		nItG_(4*(2*nMatG_ + 1)), 
 		DeltaInv_(nItG_/beta_),
-		green_(new double[4*nItG_]) {
+		own_(!green),
+		green_(green ? green : new double[4*nItG_]) {
 			std::memset(green_, 0, 4*nItG_*sizeof(double));	
 		};
+		/* Number of doubles of the accumulation of a component : four per time slice */
+		static std::size_t size(json const& jNumericalParams) { return 4*4*(2*nMat(jNumericalParams) + 1);};
+		double deltaInv() const { return DeltaInv_;};
 		/** 
 		* 
 		* void add(double time, double value)
@@ -100,7 +114,7 @@ namespace Green {
 			
 			std::memset(green_, 0, 4*nItG_*sizeof(double));
 		};
-		~Meas() { delete[] green_;};
+		~Meas() { if(own_) delete[] green_;};
 	private:
 		std::string const name_;
 		
@@ -110,7 +124,10 @@ namespace Green {
 		int const nItG_;
 		double const DeltaInv_;
 		
+		bool const own_;
 		double* const green_;
+		
+		static int nMat(json const& jNumericalParams) { return jNumericalParams["beta"].get<double>()*jNumericalParams["EGreen"].get<double>()/(2*M_PI) + 1;};
 	};
 	
 };
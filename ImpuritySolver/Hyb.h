@@ -8,6 +8,7 @@
 #include <map>
 #include <algorithm>
 #include <sstream>
+#include <cstdint>
 #include "nlohmann_json.hpp"
 #include "Utilities.h"
 using json=nlohmann::json;
@@ -16,62 +17,145 @@ namespace Hyb {
 
 	/** 
 	* 
-	* json read(json const& jComponentIn, double betaOut)
+	* struct Matsubara
 	* 
-	* Parameters :	jComponentIn : component of the Matsubara function that is being read
-	*				betaOut : beta of the program in which the function needs to be transformed
-	*
-	* Returns:
-	*	A json object containing the real part ("real" attribute) and the imaginary part("imag" attribute) of the input function
-	*	with a beta adapted to the simualtion betaOut. 
-	*	The other attributes of jComponentIn are simply copied
-	*
 	* Description: 
-	*   Reads the hybridization function from the jComponentIn array.
-	* 	I name beta = jComponentIn["beta"]
-	*	As we are in Fourrier space with Matsubara frequencies PI*(2*m+1)/beta, we need to adapt the read data to the beta in the simulation.
-	*	This function computes function(iwn) from function(iwm) with wm = PI*(2*m+1)/beta, wn = PI*(2*n+1)/betaOut using linear interpolation.
-	* 	The input function is (jComponentIn["real"] + i*jComponentIn["imag"])
-	* 
+	*	Function on the fermionic Matsubara frequencies PI*(2*n+1)/beta, stored as one contiguous complex array,
+	*	together with the beta of the frequencies and the first and second moments of the high frequency expansion.
+	*	Missing moments are zero.
 	*/
-	json read(json const& jComponentIn, double betaOut) {
-		json jComponentOut = jComponentIn;
-		double const betaIn = jComponentIn["beta"];
-		if(jComponentIn["real"].size() != jComponentIn["imag"].size()) 
-			throw std::runtime_error("Missmatch of real and imaginary array lengths.");
+	struct Matsubara {
+		Matsubara() : beta(.0), firstMoment(.0), secondMoment(.0) {};
+		
+		double beta;
+		double firstMoment;
+		double secondMoment;
+		std::vector<Ut::complex> data;
 		
-		jComponentOut["real"] = json::array();
-		jComponentOut["imag"] = json::array();
-		int n = 0;
-		for(int m = 1; m < static_cast<int>(jComponentIn["real"].size()); ++m) { 
-			double z0 = M_PI*(2*m - 1)/betaIn;
-			double z1 = M_PI*(2*m + 1)/betaIn;
+		/** 
+		* 
+		* void setBeta(double betaOut)
+		* 
+		* Parameters :	betaOut : beta of the program in which the function needs to be transformed
+		*
+		* Description: 
+		*	As we are in Fourrier space with Matsubara frequencies PI*(2*m+1)/beta, we need to adapt the read data to the beta in the simulation.
+		*	This function computes function(iwn) from function(iwm) with wm = PI*(2*m+1)/beta, wn = PI*(2*n+1)/betaOut using linear interpolation.
+		*	The data is changed in place when betaOut <= beta, as every output frequency then only depends on input frequencies with the same or a larger index.
+		*/
+		void setBeta(double betaOut) {
+			if(betaOut == beta) return;
 			
-			Ut::complex h0(jComponentIn["real"][m - 1], jComponentIn["imag"][m - 1]);
-			Ut::complex h1(jComponentIn["real"][m], jComponentIn["imag"][m]);
+			std::vector<Ut::complex> temp; std::vector<Ut::complex> const* in = &data;
+			if(betaOut > beta) { temp.swap(data); in = &temp;}
 			
-			for(; (2*n + 1)/betaOut <= (2*m + 1)/betaIn; ++n) {
-				double w = M_PI*(2*n + 1)/betaOut;
-				std::complex<double> value = h0 + (h1 - h0)*(w - z0)/(z1 - z0);
-				jComponentOut["real"].push_back(value.real());
-				jComponentOut["imag"].push_back(value.imag());
+			double const betaIn = beta;
+			int n = 0;
+			for(int m = 1; m < static_cast<int>(in->size()); ++m) { 
+				double z0 = M_PI*(2*m - 1)/betaIn;
+				double z1 = M_PI*(2*m + 1)/betaIn;
+				
+				Ut::complex const h0 = (*in)[m - 1];
+				Ut::complex const h1 = (*in)[m];
+				
+				for(; (2*n + 1)/betaOut <= (2*m + 1)/betaIn; ++n) {
+					double w = M_PI*(2*n + 1)/betaOut;
+					Ut::complex value = h0 + (h1 - h0)*(w - z0)/(z1 - z0);
+					if(in == &data) data[n] = value; else data.push_back(value);
+				}
 			}
-		}
-		jComponentOut["beta"] = betaOut;
-		return jComponentOut;
+			if(in == &data) data.resize(n);
+			beta = betaOut;
+		};
+	};
+	
+	typedef std::map<std::string, Matsubara> MatsubaraMap;
+	
+	/** 
+	* 
+	* struct MatsubaraReader
+	* 
+	* Description: 
+	*	SAX handler of the json parser, filling a MatsubaraMap in a single pass over the text (read more about the format in README.MD).
+	*	The "real" and "imag" arrays are directly appended to the complex array of the component, 
+	*	no intermediate json object is built.
+	*/
+	struct MatsubaraReader : nlohmann::json_sax<json> {
+		explicit MatsubaraReader(MatsubaraMap& functions) : functions_(functions), depth_(0), array_(false) {};
+		
+		bool start_object(std::size_t) {
+			if(++depth_ == 2) { 
+				current_ = Matsubara(); real_.clear(); imag_.clear();
+			}
+			return true;
+		};
+		bool end_object() {
+			if(depth_-- == 2) {
+				if(real_.size() != imag_.size()) 
+					throw std::runtime_error("Missmatch of real and imaginary array lengths.");
+				current_.data.resize(real_.size());
+				for(std::size_t m = 0; m < real_.size(); ++m) current_.data[m] = Ut::complex(real_[m], imag_[m]);
+				std::swap(functions_[component_], current_);
+			}
+			return true;
+		};
+		bool key(string_t& val) {
+			if(depth_ == 1) component_ = val; else if(depth_ == 2) key_ = val;
+			return true;
+		};
+		bool start_array(std::size_t) { array_ = depth_ == 2; return true;};
+		bool end_array() { array_ = false; return true;};
+		
+		bool number_integer(number_integer_t val) { return number(val);};
+		bool number_unsigned(number_unsigned_t val) { return number(val);};
+		bool number_float(number_float_t val, string_t const&) { return number(val);};
+		
+		bool null() { return true;};
+		bool boolean(bool) { return true;};
+		bool string(string_t&) { return true;};
+		bool binary(binary_t&) { return true;};
+		
+		bool parse_error(std::size_t, std::string const&, nlohmann::detail::exception const& ex) {
+			throw std::runtime_error(ex.what());
+		};
+	private:
+		MatsubaraMap& functions_;
+		
+		int depth_; bool array_;
+		std::string component_, key_;
+		Matsubara current_;
+		std::vector<double> real_, imag_;
+		
+		bool number(double val) {
+			if(depth_ != 2) return true;
+			if(array_) {
+				if(key_ == "real") real_.push_back(val); else if(key_ == "imag") imag_.push_back(val);
+			} else {
+				if(key_ == "beta") current_.beta = val;
+				else if(key_ == "First Moment") current_.firstMoment = val;
+				else if(key_ == "Second Moment") current_.secondMoment = val;
+			}
+			return true;
+		};
+	};
+	
+	/* Reads all the components of the Matsubara file content text into functions */
+	void parse(std::string const& text, MatsubaraMap& functions) {
+		MatsubaraReader reader(functions);
+		json::sax_parse(text, &reader);
 	};
 	/* Constructs the Hybridization Function in the imaginary time space */
 	struct Function {
 	/** 
 		* 
-		* Function(std::string name, json const& jNumericalParams, json const& jEntry)
+		* Function(std::string name, json const& jNumericalParams, Matsubara const& entry)
 		* 
 		* Parameters :	name : name of the Entry
 		*				jNumericalParams : numerical parameters of the simulation
-		*				jEntry : Entry
+		*				entry : Matsubara entry
 		*
 		* Description: 
-		*   Reads the matsubara entry from the json Object jEntry.
+		*   Reads the matsubara entry.
 		*	Transforms the entry(Matsubara frequencies) to imaginary time with a Fourrier Transform
 		* 	The little trick here is the following : 
 		*		As the self-energy computed with this hybridation has high statisctical noise at high Matsubara frequency, we use a trick to compute the hybridation to correct this noise.
@@ -79,35 +163,41 @@ namespace Hyb {
 		*		We then compute numerically the remaining part of the fourrier transform thus reducing numerical noise.
 		*		For more details, see appendix B.3 and B.1 of E. Gull's PHD Thesis (link: https://www.research-collection.ethz.ch/handle/20.500.11850/104013)
 		* 	Stores the result for use in the Program
+		*	The table is the same on every processor, so it is stored once per node (see mpi::SharedArray) : only the first processor of every node computes it,
+		*	the other processors of the node map it read only. Needs to be called by all processors of the group.
 		*/
-		Function(std::string name, json const& jNumericalParams, json const& jEntry) : 
+		Function(std::string name, json const& jNumericalParams, Matsubara const& entry) : 
 		beta_(jNumericalParams["beta"]), 
-		nItH_(jNumericalParams["EHyb"].get<double>()*jNumericalParams["EHyb"].get<double>()*beta_ + 1), 
-		hyb_(new double[nItH_ + 1]) {
+		cubic_(exists(jNumericalParams, "HYB_INTERPOLATION") && jNumericalParams["HYB_INTERPOLATION"] == "cubic"),
+		nItH_(cubic_ ? segments(jNumericalParams) : jNumericalParams["EHyb"].get<double>()*jNumericalParams["EHyb"].get<double>()*beta_ + 1), 
+		storage_(cubic_ ? 4*(nItH_ + 1) + 8 : nItH_ + 1),
+		hyb_(cubic_ ? align(storage_.data()) : storage_.data()) {
 			std::cout << "Initialising data entry " << name << " ... ";
 			
-			double const FM = jEntry["First Moment"]; 
-			double const SM = jEntry["Second Moment"];
-			
-			for(int i = 0; i < nItH_ + 1; ++i) {
-				double time = beta_*i/static_cast<double>(nItH_);
-				hyb_[i] = -FM/2. + SM*(time - beta_/2.)/2.;
-			}
-			   
-			/* Adapts the Hyb entry to the current beta_ */
-			json jHybWithRightBeta = read(jEntry, beta_);
-			json jReal = jHybWithRightBeta["real"];
-			json jImag = jHybWithRightBeta["imag"];
-			/* Creates the imaginary time data */
-			for(unsigned int m = 0; m < jReal.size(); ++m) {
-				Ut::complex z(.0, M_PI*(2*m + 1)/beta_);
-				Ut::complex value = std::complex<double>(jReal[m],jImag[m]) - FM/z - SM/(z*z);
-				for(int i = 0; i < nItH_ + 1; ++i) {
-					double arg = M_PI*(2*m + 1)*i/static_cast<double>(nItH_); 
-					hyb_[i] += 2./beta_*(value.real()*std::cos(arg) + value.imag()*std::sin(arg));
-				}
+			if(storage_.writer()) {
+				if(cubic_) {
+					std::vector<double> grid(3*nItH_ + 1);
+					transform(entry, 3*nItH_, grid.data());
+					
+					/* Cubic through the four equidistant points of every segment, written as c0 + c1*t + c2*t^2 + c3*t^3 with t in [0,1) */
+					for(int s = 0; s < nItH_; ++s) {
+						double const* y = grid.data() + 3*s; double* c = hyb_ + 4*s;
+						double const D1 = y[1] - y[0];
+						double const D2 = y[2] - 2.*y[1] + y[0];
+						double const D3 = y[3] - 3.*y[2] + 3.*y[1] - y[0];
+						c[0] = y[0];
+						c[1] = 3.*(D1 - D2/2. + D3/3.);
+						c[2] = 9.*(D2 - D3)/2.;
+						c[3] = 27.*D3/6.;
+					}
+					/* One more constant segment, so that get(beta) stays in the table */
+					hyb_[4*nItH_] = grid.back(); hyb_[4*nItH_ + 1] = hyb_[4*nItH_ + 2] = hyb_[4*nItH_ + 3] = .0;
+				} else 
+					transform(entry, nItH_, hyb_);
 			}
 			
+			storage_.publish();
+			
 			std::cout << "Ok" << std::endl;
 		};
 		/** 
@@ -115,33 +205,101 @@ namespace Hyb {
 		* 
 		* Parameters :	time : time at wich we wànt the hybridation function
 		*
-		* Return Value : the  function at time `time` using linear interpolation on the discretized hybridation function we read from file
+		* Return Value : the  function at time `time` using linear interpolation on the discretized hybridation function we read from file,
+		*				 or the piecewise cubic if HYB_INTERPOLATION is "cubic"
 		*/
 		double get(double time) const { 
 			double it = time/beta_*nItH_; int i0 = static_cast<int>(it);
+			if(cubic_) {
+				double const t = it - i0; double const* c = hyb_ + 4*i0;
+				return ((c[3]*t + c[2])*t + c[1])*t + c[0];
+			}
 			return (1. - (it - i0))*hyb_[i0] + (it - i0)*hyb_[i0 + 1];
 		};
-		
-		~Function() { delete[] hyb_;};
+
 	private:
 		double const beta_;
-		int const nItH_;
+		bool const cubic_;
+		int const nItH_;    //Number of intervals of the linear table, or number of cubic segments
 		
+		mpi::SharedArray storage_;
 		double* const hyb_;
+		
+		/** 
+		* int segments(json const& jNumericalParams)
+		* 
+		* Return Value : the number of cubic segments, HYB_SEGMENTS if given, else EHyb*beta.
+		*
+		* Description: 
+		*	With a segment width of 1/EHyb the cubic has the same accuracy as the linear table on EHyb^2*beta points,
+		*	with about EHyb/4 times less memory. The four coefficients of a segment are contiguous and the table is aligned 
+		*	on a cache line, so that a lookup touches a single line.
+		*/
+		static int segments(json const& jNumericalParams) {
+			if(exists(jNumericalParams, "HYB_SEGMENTS")) return jNumericalParams["HYB_SEGMENTS"];
+			return std::ceil(jNumericalParams["EHyb"].get<double>()*jNumericalParams["beta"].get<double>());
+		};
+		static double* align(double* ptr) {
+			return reinterpret_cast<double*>((reinterpret_cast<std::uintptr_t>(ptr) + 63) & ~static_cast<std::uintptr_t>(63));
+		};
+		/** 
+		* void transform(Matsubara const& entry, int nIt, double* grid)
+		* 
+		* Parameters :	entry : Matsubara entry
+		*				nIt : number of intervals of the imaginary time grid
+		*				grid : output, the function on the nIt + 1 times beta*i/nIt
+		*
+		* Description: 
+		*	Fourier transform to imaginary time, with the high frequency tail treated exactly (see the constructor).
+		*	The grid is only computed on the first processor and then broadcasted to the first processors of the other nodes, which are the only ones calling it.
+		*	Instead of calling cos and sin for every frequency and every time, the phases of all the frequencies are rotated 
+		*	together from one time to the next. They are recomputed exactly every few steps to keep the rounding errors at the machine precision.
+		*/
+		void transform(Matsubara const& entry, int nIt, double* grid) const {
+			if(mpi::rank() == mpi::master) {
+				double const FM = entry.firstMoment; 
+				double const SM = entry.secondMoment;
+				
+				/* Adapts the Hyb entry to the current beta_ */
+				Matsubara hybWithRightBeta = entry; hybWithRightBeta.setBeta(beta_);
+				std::vector<Ut::complex> const& data = hybWithRightBeta.data;
+				
+				int const nMat = data.size();
+				std::vector<double> valueR(nMat), valueI(nMat), stepR(nMat), stepI(nMat), phaseR(nMat), phaseI(nMat);
+				for(int m = 0; m < nMat; ++m) {
+					Ut::complex z(.0, M_PI*(2*m + 1)/beta_);
+					Ut::complex value = 2./beta_*(data[m] - FM/z - SM/(z*z));
+					valueR[m] = value.real(); valueI[m] = value.imag();
+					
+					double arg = M_PI*(2*m + 1)/static_cast<double>(nIt);
+					stepR[m] = std::cos(arg); stepI[m] = std::sin(arg);
+				}
+				
+				/* Creates the imaginary time data */
+				int const anchor = 256;
+				for(int i = 0; i < nIt + 1; ++i) {
+					if(i%anchor == 0) 
+						for(int m = 0; m < nMat; ++m) {
+							double arg = M_PI*(2*m + 1)*i/static_cast<double>(nIt); 
+							phaseR[m] = std::cos(arg); phaseI[m] = std::sin(arg);
+						}
+					
+					double time = beta_*i/static_cast<double>(nIt);
+					double sum = -FM/2. + SM*(time - beta_/2.)/2.;
+					for(int m = 0; m < nMat; ++m) {
+						sum += valueR[m]*phaseR[m] + valueI[m]*phaseI[m];
+						
+						double const temp = phaseR[m]*stepR[m] - phaseI[m]*stepI[m];
+						phaseI[m] = phaseI[m]*stepR[m] + phaseR[m]*stepI[m];
+						phaseR[m] = temp;
+					}
+					grid[i] = sum;
+				}
+			}
+			
+			mpi::bcast(grid, nIt + 1, mpi::leaders());
+		};
 	};
-	
-	//------------------------------------------------------------------------------------------------------------------------------------------
-	/**************************************************************************************************/
-	/*              This function adapts the Matsubara data file completely to betaOut                */
-	/*                          The jObject is just changed in place                                  */
-	/**************************************************************************************************/
-	void accountForDifferentBeta(json& jObject,double const betaOut){
-		json const& jTemp = jObject;
-		/* It changes the beta for all components in jObject */
-		for (auto& el : jTemp.items()){
-			jObject[el.key()] = read(jTemp[el.key()],betaOut);
-		} 
-	}
 };
 
 #endif
\ No newline at end of file
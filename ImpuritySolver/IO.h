@@ -3,6 +3,10 @@
 
 #include "nlohmann_json.hpp"
 #include <fstream>
+#include <valarray>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 using json=nlohmann::json;
 
 
@@ -72,5 +76,69 @@ namespace IO
         }
     }
     /*************************************************************************************************************************/
+    /*************************************************************************************************************************/
+    /* Binary measurement file, written instead of the big Measurements and Errors fields of the .meas.json file             */
+    /* Layout : "CTSEGBIN" | header size (uint64) | json header | doubles                                                   */
+    /* The header lists for each observable its shape and the offsets (in doubles from the beginning of the data) of its     */
+    /* mean, its error and optionally its bins (the mean of every processor). Everything is written little-endian and the    */
+    /* header is padded so that the doubles are aligned, which allows the reader to memory map the file.                     */
+    /*************************************************************************************************************************/
+    struct BinaryMeasurements {
+        BinaryMeasurements() : size_(0) {};
+        
+        void add(std::string const& name, std::valarray<double> const& mean, std::valarray<double> const& error, std::valarray<double> const& bins, int nBins) {
+            json jEntry;
+            jEntry["shape"] = {mean.size()};
+            jEntry["mean"] = push(mean);
+            jEntry["error"] = push(error);
+            if(nBins) {
+                jEntry["bins shape"] = {nBins, mean.size()};
+                jEntry["bins"] = push(bins);
+            }
+            jIndex_[name] = jEntry;
+        };
+        
+        json const& index() const { return jIndex_;};
+        
+        void write(std::string const fileName) const {
+            json jHeader;
+            jHeader["version"] = 1;
+            jHeader["observables"] = jIndex_;
+            std::string header = jHeader.dump();
+            header.resize(8*((header.size() + 7)/8), ' ');
+            
+            std::ofstream file(fileName, std::ios::binary); 
+            if(!file) throw std::runtime_error("couldn't write to" + fileName);
+            
+            file.write("CTSEGBIN", 8);
+            std::uint64_t headerSize = header.size();
+            writeLittleEndian(file, reinterpret_cast<char const*>(&headerSize), sizeof(headerSize), 1);
+            file.write(header.data(), header.size());
+            for(std::vector<std::valarray<double> >::const_iterator it = data_.begin(); it != data_.end(); ++it) 
+                if(it->size()) writeLittleEndian(file, reinterpret_cast<char const*>(&(*it)[0]), sizeof(double), it->size());
+        };
+    private:
+        std::size_t size_;
+        json jIndex_;
+        std::vector<std::valarray<double> > data_;
+        
+        std::size_t push(std::valarray<double> const& array) {
+            std::size_t offset = size_;
+            data_.push_back(array); size_ += array.size();
+            return offset;
+        };
+        
+        static void writeLittleEndian(std::ofstream& file, char const* data, std::size_t size, std::size_t n) {
+            std::uint16_t const test = 1;
+            if(*reinterpret_cast<char const*>(&test)) {
+                file.write(data, size*n);
+            } else {
+                std::vector<char> swapped(data, data + size*n);
+                for(std::size_t i = 0; i < n; ++i) std::reverse(swapped.begin() + i*size, swapped.begin() + (i + 1)*size);
+                file.write(swapped.data(), swapped.size());
+            }
+        };
+    };
+    /*************************************************************************************************************************/
 }
 #endif
\ No newline at end of file
@@ -16,10 +16,10 @@ namespace Link {
 	struct Link {
 	/** 
 		* 
-		* Link(json const& jNumericalParams, json const& jHyb, json const& jLink, Ut::Measurements& measurements)
+		* Link(json const& jNumericalParams, Hyb::MatsubaraMap const& hyb, json const& jLink, Ut::Measurements& measurements)
 		* 
 		* Parameters :	jNumericalParams : storage of all the numerical parameters of the simulation
-		*				jHyb : storage of the hybridization informations (read more in README.MD)
+		*				hyb : components of the hybridization function (read more in README.MD)
 		*				jLink : storage of the link informations (read more in README.MD)
 		*				simulation : Object used to store the parameters and the measurements throughout the simulation
 		* 
@@ -28,18 +28,20 @@ namespace Link {
 		* Description: 
 		*   Constructs the hyb function from the Link and Hyb files (making it possible to read the hybridation function between each sites)
 		*	Reserves some space for the green function to be saved in
+		*	Groups the flavors in the blocks of the bath matrix (see blocks())
 		* 
 		*/
-		Link(json const& jNumericalParams, json const& jHyb, json const& jLink, Ut::Measurements& measurements) : 
+		Link(json const& jNumericalParams, Hyb::MatsubaraMap const& hyb, json const& jLink, Ut::Measurements& measurements) : 
 		beta_(jNumericalParams["beta"]), 
 		//The Link object includes spins up and down so the number of site is half the Link array size
 		nSite_(jLink.size()/2),
 		greenEntry_(new Entry[4*nSite_*nSite_]), 
 		hybEntry_(new Entry[4*nSite_*nSite_]), 
-		multiplicity_(jHyb.size(), 0) {	
+		multiplicity_(hyb.size(), 0),
+		blocks_(2*nSite_, 0) {	
 			std::map<std::string, int> entryIndex; int index = 0;
-			for (auto& el : jHyb.items()){
-			    entryIndex[el.key()] = index++; 
+			for (auto& el : hyb){
+			    entryIndex[el.first] = index++; 
 			}
 				
 			
@@ -76,13 +78,43 @@ namespace Link {
 			
 			std::cout << std::endl << "... Ok" << std::endl << std::endl;
 			
+			if(!exists(jNumericalParams, "BATH_BLOCKS") || jNumericalParams["BATH_BLOCKS"].get<bool>()) {
+				//Connected components of the flavors, two flavors being connected by a non empty entry : every flavor takes the smallest label of its component
+				for(std::size_t f = 0; f < 2*nSite_; ++f) blocks_[f] = f;
+				
+				bool changed = true;
+				while(changed) {
+					changed = false;
+					for(std::size_t i = 0; i < 2*nSite_; ++i) 
+						for(std::size_t j = 0; j < 2*nSite_; ++j) 
+							if(hybEntry_[i + 2*nSite_*j].index != -1 && blocks_[i] != blocks_[j]) {
+								blocks_[i] = blocks_[j] = std::min(blocks_[i], blocks_[j]); changed = true;
+							}
+				}
+				
+				//Numbers the blocks from 0
+				std::vector<int> label(2*nSite_, -1); int nBlocks = 0;
+				for(std::size_t f = 0; f < 2*nSite_; ++f) {
+					if(label[blocks_[f]] == -1) label[blocks_[f]] = nBlocks++;
+					blocks_[f] = label[blocks_[f]];
+				}
+			}
+			
+			std::cout << "Blocks of the bath matrix : " << *std::max_element(blocks_.begin(), blocks_.end()) + 1 << std::endl << std::endl;
+			
 			hyb_ = allocHyb_.allocate(multiplicity_.size());
 			green_ = allocGreen_.allocate(multiplicity_.size());
 			
+			//The accumulations of all components are in one array, the one of component index starts at index*greenStride_. 
+			//The four last doubles take the empty entries in measure(), they are never read.
+			greenStride_ = Green::Meas::size(jNumericalParams);
+			greenArena_ = new double[multiplicity_.size()*greenStride_ + 4];
+			
 			for(std::map<std::string, int>::const_iterator it = entryIndex.begin(); it != entryIndex.end(); ++it) {
-				new(hyb_ + it->second) Hyb::Function(it->first, jNumericalParams, jHyb[it->first]);
-				new(green_ + it->second) Green::Meas(it->first, jNumericalParams, measurements);
+				new(hyb_ + it->second) Hyb::Function(it->first, jNumericalParams, hyb.at(it->first));
+				new(green_ + it->second) Green::Meas(it->first, jNumericalParams, measurements, greenArena_ + it->second*greenStride_);
 			}
+			greenDeltaInv_ = multiplicity_.size() ? green_[0].deltaInv() : .0;
 		};
 		/** 
 		* 
@@ -109,35 +141,66 @@ namespace Link {
 			
 			return .0;
 		};
-				/** 
+		/** 
 		* 
-		* template<class GreenIterator>
-		* void measure(int sign, GreenIterator begin, GreenIterator end)
+		* template<class Ops, class Op> void column(Ops const& opsL, Op const& opR, double* column) const
+		* template<class Op, class Ops> void row(Op const& opL, Ops const& opsR, double* row) const
+		* 
+		* Parameters :	opsL, opsR : operators stored as a structure of arrays (sites, spins and times in separate arrays, see Ba::Operators)
+		*				opR, opL : the fixed operator of the column or of the row
+		*				column, row : output arrays of size opsL.size() or opsR.size()
+		* 
+		* Description :
+		*	Batched versions of operator() : column[n] = (*this)(opsL[n], opR) and row[n] = (*this)(opL, opsR[n]).
+		*	As the fixed operator is the same for the whole vector, the entry table is offset once and the remaining loop has no branch
+		*	on the time sign, which lets the compiler vectorize the time differences and the interpolation.
+		* 
+		*/
+		template<class Ops, class Op> void column(Ops const& opsL, Op const& opR, double* column) const {
+			fill(opsL.size(), opsL.site(), opsL.spin(), opsL.time(), hybEntry_ + 2*nSite_*(opR.spin()*nSite_ + opR.site()), 1, opR.time(), 1., column);
+		};
+		template<class Op, class Ops> void row(Op const& opL, Ops const& opsR, double* row) const {
+			fill(opsR.size(), opsR.site(), opsR.spin(), opsR.time(), hybEntry_ + (opL.spin()*nSite_ + opL.site()), 2*nSite_, opL.time(), -1., row);
+		};
+		/** 
+		* 
+		* template<class Block>
+		* void measure(int sign, Block const& block)
 		* 
 		* Parameters :	sign : current sign of the bath
-		*				begin : start of the green matrix
-		*				end : end of the green matrix
+		*				block : block of the bath matrix (see Ba::Block), with the operators of its rows (opsR) and columns (opsL) and the Green matrix B
 		* 
 		* Description :
 		*	Adds the current green function value to the green function measurements
-		*	For each element in the Green matrix (between begin and end), adds its contribution to the imaginary time green's function.
+		*	For each element in the Green matrix, adds its contribution to the imaginary time green's function (see Green::Meas::add).
+		*	The matrix is done column by column : the operator of the column is fixed, so that the entry table is offset once, as in column().
+		*	A first pass without branches computes where every element goes in the accumulation array of all components, its value and its time 
+		*	within the time slice, the second pass adds them up in the same order as before.
+		*	The elements of empty entries go to four spare doubles at the end of the array, so that the second pass has no branch either.
 		* 
 		*/	
-		template<class GreenIterator>
-		void measure(int sign, GreenIterator begin, GreenIterator end) {
-			for(GreenIterator it = begin; it != end; ++it) {
-				Entry entry = greenEntry_[(it.opR().spin()*nSite_ + it.opR().site()) + 2*nSite_*(it.opL().spin()*nSite_ + it.opL().site())];
+		template<class Block>
+		void measure(int sign, Block const& block) {
+			std::size_t const N = block.size();
+			if(!N) return;
+			
+			if(offset_.size() < N) { offset_.resize(N); value_.resize(N); dtime_.resize(N);}
+			
+			double const* B = block.data();
+			for(std::size_t l = 0; l < N; ++l, B += N) {
+				auto const opL = block.opsL()[l];
+				prepare(N, block.opsR().site(), block.opsR().spin(), block.opsR().time(), greenEntry_ + 2*nSite_*(opL.spin()*nSite_ + opL.site()), opL.time(), sign, B);
 				
-				if(entry.index != -1) {
-					double time = entry.arg*(it.opR().time() - it.opL().time()); 
-					double value = sign*entry.fact*it.value();
-					
-					if(time < .0) {
-						value *= -1.;
-						time += beta_;
-					}
-					
-					green_[entry.index].add(time, value);  //Spin !!!!
+				for(std::size_t n = 0; n < N; ++n) {
+					double* green = greenArena_ + offset_[n];
+					double value = value_[n]; double const Dtime = dtime_[n];
+					*green++ += value; 
+					value *= Dtime;
+					*green++ += value;
+					value *= Dtime;
+					*green++ += value;
+					value *= Dtime;
+					*green += value;
 				}
 			}
 		};
@@ -157,6 +220,19 @@ namespace Link {
 				green_[i].measure(measurements, multiplicity_[i]*measurementsFromLastStore);
 		};
 		
+		/** 
+		* 
+		* std::vector<int> const& blocks() const
+		* 
+		* Return Value : the block of the bath matrix of every flavor (spin*nSite + site)
+		* 
+		* Description :
+		*	The blocks are the connected components of the flavors, two flavors being connected if the hybridisation between them is not empty. 
+		*	The bath matrix is block diagonal in these blocks (see Ba::Bath). With BATH_BLOCKS false, all the flavors are in the same block.
+		* 
+		*/
+		std::vector<int> const& blocks() const { return blocks_;};
+		
 		~Link() { 
 			for(unsigned int i = 0; i < multiplicity_.size(); ++i) {
 				green_[i].~Meas();
@@ -164,6 +240,7 @@ namespace Link {
 			}
 			allocGreen_.deallocate(green_, multiplicity_.size());
 		    allocHyb_.deallocate(hyb_, multiplicity_.size());	
+			delete[] greenArena_;
 			
 			delete[] hybEntry_;
 			delete[] greenEntry_; 
@@ -183,8 +260,44 @@ namespace Link {
 		Entry* const hybEntry_;
 		
 		std::vector<int> multiplicity_;
+		std::vector<int> blocks_;
 		Hyb::Function* hyb_;
 		Green::Meas* green_;
+		
+		double* greenArena_;
+		std::size_t greenStride_;
+		double greenDeltaInv_;
+		std::vector<std::ptrdiff_t> offset_;    //Work arrays of measure()
+		std::vector<double> value_;
+		std::vector<double> dtime_;
+		
+		/* Common kernel of column() and row() : out[n] = fact*hyb(orientation*arg*(time[n] - time0)) for the entries[stride*flavor[n]] */
+		void fill(std::size_t N, int const* site, int const* spin, double const* time, Entry const* entries, std::size_t stride, double time0, double orientation, double* out) const {
+			for(std::size_t n = 0; n < N; ++n) {
+				Entry const& entry = entries[stride*(spin[n]*nSite_ + site[n])];
+				
+				double const tau = orientation*entry.arg*(time[n] - time0);
+				double const wrap = tau < .0 ? 1. : .0;
+				
+				out[n] = entry.index != -1 ? (1. - 2.*wrap)*entry.fact*hyb_[entry.index].get(tau + wrap*beta_) : .0;
+			}
+		};
+		/* First pass of measure() over a column of the Green matrix : offset_[n] in the accumulation array (the spare doubles for an empty entry), value_[n] and dtime_[n] as in Green::Meas::add */
+		void prepare(std::size_t N, int const* site, int const* spin, double const* time, Entry const* entries, double time0, int sign, double const* B) {
+			std::ptrdiff_t const spare = multiplicity_.size()*greenStride_;
+			for(std::size_t n = 0; n < N; ++n) {
+				Entry const& entry = entries[spin[n]*nSite_ + site[n]];
+				
+				double const tau = entry.arg*(time[n] - time0);
+				double const wrap = tau < .0 ? 1. : .0;
+				double const t = tau + wrap*beta_;
+				
+				int const index = static_cast<int>(greenDeltaInv_*t);
+				dtime_[n] = t - static_cast<double>(index + .5)/greenDeltaInv_;
+				value_[n] = (1. - 2.*wrap)*(sign*entry.fact*B[n]);
+				offset_[n] = entry.index != -1 ? entry.index*static_cast<std::ptrdiff_t>(greenStride_) + 4*index : spare;
+			}
+		};
 	};
 };
 
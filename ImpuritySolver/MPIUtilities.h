@@ -9,6 +9,8 @@
 #include <sstream>
 #include "nlohmann_json.hpp"
 #include <valarray>
+#include <vector>
+#include <cstdint>
 #include "IO.h"
 using json=nlohmann::json;
 
@@ -16,33 +18,101 @@ namespace mpi {
 	//-----------------------------------------------------------------------------------------------------------------------------------------------------
 	int const master = 0;
 	
-	/* Returns the rank of the current processor in the processor world*/
-	int rank() {
+#ifdef HAVE_MPI
+	typedef MPI_Comm Comm;
+#else
+	typedef int Comm;
+#endif
+	
+	/* Returns the communicator of all processors */
+	Comm world() {
+#ifdef HAVE_MPI
+		return MPI_COMM_WORLD;
+#else
+		return 0;
+#endif
+	};
+	
+	/* Returns the communicator of the processors which work on the same parameter set, the world unless it has been split (see split()). 
+	   All the functions below work on it unless they are given another communicator. */
+	Comm& group() {
+		static Comm group = world();
+		return group;
+	};
+	
+	/* Returns the rank of the current processor in the communicator */
+	int rank(Comm comm = group()) {
 		int temp = 0;
 		
 #ifdef HAVE_MPI		
-		MPI_Comm_rank(MPI_COMM_WORLD, &temp);
+		MPI_Comm_rank(comm, &temp);
 #endif
 		
 		return temp;
 	};
 	
-	/* Returns the number of processors in the processor world*/
-	int number_of_workers() {
+	/* Returns the number of processors in the communicator */
+	int number_of_workers(Comm comm = group()) {
 		int temp = 1;
 		
 #ifdef HAVE_MPI
-		MPI_Comm_size(MPI_COMM_WORLD, &temp);
+		MPI_Comm_size(comm, &temp);
 #endif
 		
 		return temp;
 	};
-	/* Reads a json file on the main processor and distributes it to the other processors */
-	void read_json(std::string name, json& jObject) {
+	
+	/* Waits for all the processors of the communicator */
+	void barrier(Comm comm = group()) {
+#ifdef HAVE_MPI
+		MPI_Barrier(comm);
+#endif
+	};
+	
+	/* Splits the world into groups of consecutive processors, as evenly as possible, and makes the group of the processor the default communicator. 
+	   Returns the index of the group of the processor. Needs to be called by all processors. */
+	int split(int groups) {
+		int const size = number_of_workers(world());
+		if(groups < 1 || groups > size) throw std::runtime_error("mpi::split: " + std::to_string(groups) + " groups for " + std::to_string(size) + " processors");
+		
+		int const index = static_cast<int64_t>(rank(world()))*groups/size;
+#ifdef HAVE_MPI
+		MPI_Comm_split(world(), index, rank(world()), &group());
+#endif
+		return index;
+	};
+	
+	/* Communicators of the processors of the group which share the memory of a node (node), and of the first processor of every node of the group (leaders, 
+	   MPI_COMM_NULL on the other processors). They are built from the group the first time they are needed, and again after split(). */
+	struct Nodes { Comm group; Comm node; Comm leaders;};
+	
+	Nodes const& nodes() {
+		static Nodes nodes = Nodes(); static bool built = false;
+		
+		if(!built || nodes.group != group()) {
+#ifdef HAVE_MPI
+			if(built) {
+				MPI_Comm_free(&nodes.node);
+				if(nodes.leaders != MPI_COMM_NULL) MPI_Comm_free(&nodes.leaders);
+			}
+			MPI_Comm_split_type(group(), MPI_COMM_TYPE_SHARED, rank(), MPI_INFO_NULL, &nodes.node);
+			MPI_Comm_split(group(), rank(nodes.node) == master ? 0 : MPI_UNDEFINED, rank(), &nodes.leaders);
+#endif
+			nodes.group = group(); built = true;
+		}
+		
+		return nodes;
+	};
+	
+	Comm node() { return nodes().node;};
+	
+	Comm leaders() { return nodes().leaders;};
+	
+	/* Reads a file on the main processor and distributes its content to the other processors */
+	void read_file(std::string name, std::string& buffer, Comm comm = group()) {
 		int size;
-		std::string buffer;
 		
-		if(rank() == master) {
+		if(rank(comm) == master) {
 			std::ifstream file(name.c_str()); 
 			if(!file) throw std::runtime_error(name + " not found.");
 			
@@ -57,55 +127,72 @@ namespace mpi {
 		}			
 		
 #ifdef HAVE_MPI
-		MPI_Bcast(&size, 1, MPI_INT, master, MPI_COMM_WORLD);
+		MPI_Bcast(&size, 1, MPI_INT, master, comm);
 		
-		if(rank() != master) buffer.resize(size);
+		if(rank(comm) != master) buffer.resize(size);
 		
-		MPI_Bcast(&buffer[0], size, MPI_CHAR, master, MPI_COMM_WORLD); 
+		MPI_Bcast(&buffer[0], size, MPI_CHAR, master, comm); 
 #endif
-		
-		jObject = json::parse(&buffer[0],&buffer[0] + size);
+	}
+	
+	/* Reads a json file on the main processor and distributes it to the other processors */
+	void read_json(std::string name, json& jObject, Comm comm = group()) {
+		std::string buffer; read_file(name, buffer, comm);
+		jObject = json::parse(buffer.begin(), buffer.end());
 	}	
 	
+	/* Sends the array data (of size size) of the first processor to all the other processors */
+	void bcast(double* data, int size, Comm comm = group()) {
+#ifdef HAVE_MPI
+		MPI_Bcast(data, size, MPI_DOUBLE, master, comm);
+#endif
+	}
+	
 	/* Write a json file. It waits for all processors to finish writing before continuing*/
-	void write_json(std::string name,json const& jObject) {
-		if(rank() == master) {
+	void write_json(std::string name,json const& jObject, Comm comm = group()) {
+		if(rank(comm) == master) {
 			IO::writeJsonToFile(name,jObject,true);
 		}
-#ifdef HAVE_MPI
-		MPI_Barrier(MPI_COMM_WORLD);
-#endif
+		barrier(comm);
 	};
 	/* All those functions from here have the same effect. They correspond to different datatypes */
 	/* Collects toTransmit on all processors and sums them.*/
 	/* For this one, the result is available only on the first processor */
-	void reduce(std::valarray<double> &toTransmit,std::valarray<double> &toReceive){
+	void reduce(std::valarray<double> &toTransmit,std::valarray<double> &toReceive, Comm comm = group()){
 #ifdef HAVE_MPI
-			MPI_Reduce(&toTransmit[0], mpi::rank() == mpi::master ? &toReceive[0] : 0, toTransmit.size(), MPI_DOUBLE, MPI_SUM, mpi::master, MPI_COMM_WORLD);	
+			MPI_Reduce(&toTransmit[0], rank(comm) == master ? &toReceive[0] : 0, toTransmit.size(), MPI_DOUBLE, MPI_SUM, mpi::master, comm);	
 #else
 			toReceive = toTransmit;
 #endif
 	}
 	/* For this one, the result is available only on the first processor */
-	void reduce(uint64_t &toTransmit,uint64_t &toReceive){
+	void reduce(uint64_t &toTransmit,uint64_t &toReceive, Comm comm = group()){
 #ifdef HAVE_MPI
-			MPI_Reduce(&toTransmit,&toReceive,1, MPI_INT, MPI_SUM, mpi::master, MPI_COMM_WORLD);	
+			MPI_Reduce(&toTransmit,&toReceive,1, MPI_UINT64_T, MPI_SUM, mpi::master, comm);	
+#else
+			toReceive = toTransmit;
+#endif
+	}
+	/* For this one, the result is available only on the first processor */
+	void reduce(std::vector<uint64_t> &toTransmit,std::vector<uint64_t> &toReceive, Comm comm = group()){
+#ifdef HAVE_MPI
+			MPI_Reduce(toTransmit.data(), rank(comm) == master ? toReceive.data() : 0, toTransmit.size(), MPI_UINT64_T, MPI_SUM, mpi::master, comm);	
 #else
 			toReceive = toTransmit;
 #endif
 	}
 	/* For this one, the result is available only all processors */
-	void allReduce(std::valarray<double> &toTransmit,std::valarray<double> &toReceive){
+	void allReduce(std::valarray<double> &toTransmit,std::valarray<double> &toReceive, Comm comm = group()){
 #ifdef HAVE_MPI
-			MPI_Allreduce(&toTransmit[0], &toReceive[0], toTransmit.size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);	
+			MPI_Allreduce(&toTransmit[0], &toReceive[0], toTransmit.size(), MPI_DOUBLE, MPI_SUM, comm);	
 #else
 			toReceive = toTransmit;
 #endif
 	}
 	/* For this one, the result is available only all processors */
-	void allReduce(uint64_t &toTransmit,uint64_t &toReceive){
+	void allReduce(uint64_t &toTransmit,uint64_t &toReceive, Comm comm = group()){
 #ifdef HAVE_MPI
-			MPI_Allreduce(&toTransmit, &toReceive, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);	
+			MPI_Allreduce(&toTransmit, &toReceive, 1, MPI_UINT64_T, MPI_SUM, comm);	
 #else
 			toReceive = toTransmit;
 #endif
@@ -113,14 +200,113 @@ namespace mpi {
 
 	/* For this one, insetad of summing, we take the maximum among the values. */
 	/* For this one, the result is available only all processors */
-	void getMax(uint64_t &toTransmit,uint64_t &toReceive){
+	void getMax(uint64_t &toTransmit,uint64_t &toReceive, Comm comm = group()){
 #ifdef HAVE_MPI
-			MPI_Allreduce(&toTransmit, &toReceive, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);	
+			MPI_Allreduce(&toTransmit, &toReceive, 1, MPI_UINT64_T, MPI_MAX, comm);	
 #else
 			toReceive = toTransmit;
 #endif
 	}
 
+	/** 
+	* 
+	* struct IAllReduce
+	* 
+	* Description: 
+	*	Sums an array over all processors without blocking : start() posts the local values, test() tells whether the sum is available in result().
+	*	All processors need to call start() the same number of times. Only one sum can be pending at a time.
+	*/
+	struct IAllReduce {
+		explicit IAllReduce(std::size_t size, Comm comm = group()) : comm_(comm), toTransmit_(size), toReceive_(size), pending_(false) {};
+		
+		bool pending() const { return pending_;};
+		
+		void start(std::vector<double> const& values) {
+			toTransmit_ = values; pending_ = true;
+#ifdef HAVE_MPI
+			MPI_Iallreduce(toTransmit_.data(), toReceive_.data(), toTransmit_.size(), MPI_DOUBLE, MPI_SUM, comm_, &request_);
+#else
+			toReceive_ = toTransmit_;
+#endif
+		};
+		bool test() {
+			if(!pending_) return false;
+#ifdef HAVE_MPI
+			int done; MPI_Test(&request_, &done, MPI_STATUS_IGNORE);
+			if(!done) return false;
+#endif
+			pending_ = false; 
+			return true;
+		};
+		std::vector<double> const& result() const { return toReceive_;};
+		
+		~IAllReduce() {
+#ifdef HAVE_MPI
+			if(pending_) MPI_Wait(&request_, MPI_STATUS_IGNORE);
+#endif
+		};
+	private:
+		Comm const comm_;
+		std::vector<double> toTransmit_;
+		std::vector<double> toReceive_;
+		bool pending_;
+#ifdef HAVE_MPI
+		MPI_Request request_;
+#endif
+	};
+
+	/** 
+	* 
+	* struct SharedArray
+	* 
+	* Description: 
+	*	Array of doubles in the memory of the node (MPI-3 shared memory window) : it is allocated by the first processor of the node and mapped by the others.
+	*	Only writer() may write it, and all processors of the node call publish() before reading it. Needs to be constructed and destroyed by all processors of the group.
+	*/
+	struct SharedArray {
+		explicit SharedArray(std::size_t size) : writer_(rank(node()) == master), data_(0) {
+#ifdef HAVE_MPI
+			MPI_Win_allocate_shared(writer_ ? size*sizeof(double) : 0, sizeof(double), MPI_INFO_NULL, node(), &data_, &win_);
+			if(!writer_) {
+				MPI_Aint bytes; int unit;
+				MPI_Win_shared_query(win_, master, &bytes, &unit, &data_);
+			}
+			MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+#else
+			data_ = new double[size];
+#endif
+		};
+		SharedArray(SharedArray const&) = delete;
+		SharedArray& operator=(SharedArray const&) = delete;
+		
+		bool writer() const { return writer_;};
+		double* data() const { return data_;};
+		
+		/* Makes what the writer wrote visible to the other processors of the node */
+		void publish() {
+#ifdef HAVE_MPI
+			MPI_Win_sync(win_);
+			barrier(node());
+			MPI_Win_sync(win_);
+#endif
+		};
+		
+		~SharedArray() {
+#ifdef HAVE_MPI
+			MPI_Win_unlock_all(win_);
+			MPI_Win_free(&win_);
+#else
+			delete[] data_;
+#endif
+		};
+	private:
+		bool const writer_;
+		double* data_;
+#ifdef HAVE_MPI
+		MPI_Win win_;
+#endif
+	};
+
 	/* Reads  a json on all processors. Different file name should be used in order to avoid conflicts. */
 	/* This is perfect for the config files for example */
 	void read_json_all_processors(std::string name, json& jObject) {
@@ -139,9 +325,7 @@ namespace mpi {
 				file << str();
 				file.close();
 			}
-#ifdef HAVE_MPI
-			MPI_Barrier(MPI_COMM_WORLD);
-#endif
+			barrier();
 		}
 	private:
 		std::string filename_;
@@ -14,6 +14,7 @@
 #include "Link.h"
 #include "Bath.h"
 #include "Trace.h"
+#include "Profile.h"
 using json=nlohmann::json;
 //check detailed balance for k=0 
 
@@ -26,12 +27,13 @@ namespace Ma {
 
 		/** 
 		* 
-		* MarkovChain(json const& jNumericalParams, json const& jHyb, json const& jLink,Ut::Simulation& simulation)
+		* MarkovChain(json const& jNumericalParams, Hyb::MatsubaraMap const& hyb, json const& jLink,Ut::Simulation& simulation, int chain = 0)
 		* 
 		* Parameters :	jNumericalParams : storage of all the numerical parameters of the simulation
-		*				jHyb : storage of the hybridization informations (read more in README.MD)
+		*				hyb : components of the hybridization function (read more in README.MD)
 		*				jLink : storage of the link informations (read more in README.MD)
 		*				simulation : Object used to store the parameters and the measurements throughout the simulation
+		*				chain : number of the chain on this processor, 0 but for the replicas (see MC::Replicas). It keys the random numbers and the config file
 		* 
 		* Prints :	the SEED of the QMC program
 		*			any error related to mismatches between the parameters in different files
@@ -41,39 +43,61 @@ namespace Ma {
 		*   The Markovchain constructor is used to initialize the simulation.
 		*	If the config file for the current processor is located in the outputFolder, it loads the operators from this file for the starting point
 		*	Else the program starts with an empty segment picture
+		*	With the philox RNG, the random number stream is also resumed from the config file if it has the same key (see Ut::UniformRng::load)
 		* 
 		*/
-		MarkovChain(json const& jNumericalParams, json  const& jHyb, json const& jLink, Ut::Simulation& simulation) :
+		MarkovChain(json const& jNumericalParams, Hyb::MatsubaraMap const& hyb, json const& jLink, Ut::Simulation& simulation, int chain = 0) :
 		simulation_(simulation),
 		node_(mpi::rank()),
-		rng_(jNumericalParams["SEED"].get<double>()),
-		ud_(0.,1.),
-		urng_([this](){return ud_(rng_);}),
+		chain_(chain),
+		urng_(jNumericalParams, node_, chain_),
+		replay_(exists(jNumericalParams, "REPLAY_SWEEPS")),
 		beta_(jNumericalParams["beta"]),
 		probFlip_(jNumericalParams["PROBFLIP"]),
+		probShift_(exists(jNumericalParams, "PROBSHIFT") ? jNumericalParams["PROBSHIFT"].get<double>() : .0),
+		signDiagnostics_(exists(jNumericalParams, "SIGN_DIAGNOSTICS") && jNumericalParams["SIGN_DIAGNOSTICS"].get<bool>()),
+		greenEvery_(exists(jNumericalParams, "GREEN_EVERY_SAMPLE") ? jNumericalParams["GREEN_EVERY_SAMPLE"].get<int>() : 1),
+		chiEvery_(exists(jNumericalParams, "CHI_EVERY_SAMPLE") ? jNumericalParams["CHI_EVERY_SAMPLE"].get<int>() : 1),
+		samples_(0),
 		nSite_(jLink.size()/2),
-		link_(jNumericalParams, jHyb, jLink, simulation.meas()),
+		link_(jNumericalParams, hyb, jLink, simulation.meas()),
 		trace_(nSite_, static_cast<Tr::Trace*>(0)),
-		bath_(new Ba::Bath()),
+		bath_(new Ba::Bath(link_.blocks())),
 		signTrace_(1),
 		signBath_(1),
 		accSign_(.0),
 		pK_(.0, jNumericalParams["EOrder"]),
+		accSignTrace_(.0),
+		accSignBath_(.0),
+		pKUnsigned_(.0, signDiagnostics_ ? pK_.size() : 0),
+		signChanges_(.0, signDiagnostics_ ? Prof::NMove : 0),
+		negativeAccepts_(.0, signDiagnostics_ ? Prof::NMove : 0),
 		acc_(jNumericalParams),
 		accChiij_(.0,nSite_*nSite_*acc_.Chi.size()),
-		accChiijReal_(0.,accChiij_.size()),
+		chiSite_(nSite_, static_cast<Ut::complex const*>(0)),
 		updateAcc_(2*nSite_, .0),
 		updateTot_(2*nSite_, .0),
 		updateFlipAcc_(0),
-		updateFlipTot_(0) {
+		updateFlipTot_(0),
+		updateShiftAcc_(0),
+		updateShiftTot_(0),
+		profile_(jNumericalParams),
+		drift_(.0) {
 			Ut::Measurements& measurements = simulation.meas();
 			std::cout << jNumericalParams["SEED"] << std::endl;
+			
+			//Every store needs to contain whole intervals of the Green and Chi measurements, for their normalisation
+			int const store_every_sample = jNumericalParams["STORE_EVERY_SAMPLE"];
+			if(greenEvery_ < 1 || store_every_sample % greenEvery_) 
+				throw std::runtime_error("MarkovChain: GREEN_EVERY_SAMPLE needs to divide STORE_EVERY_SAMPLE");
+			if(chiEvery_ < 1 || store_every_sample % chiEvery_) 
+				throw std::runtime_error("MarkovChain: CHI_EVERY_SAMPLE needs to divide STORE_EVERY_SAMPLE");
             
 			json jPreviousConfig;
-
+			bool resumed = false;
 
 			try{
-				mpi::read_json_all_processors(simulation_.outputFolder() + "config_" + std::to_string(node_) + ".json", jPreviousConfig);
+				mpi::read_json_all_processors(simulation_.outputFolder() + "config_" + name() + ".json", jPreviousConfig);
 				if(jPreviousConfig.size()) {
 					double beta = jPreviousConfig["beta"];
 					if(beta != beta_) throw std::runtime_error("MarkovChain: missmatch in beta");
@@ -96,6 +120,8 @@ namespace Ma {
 					int key = jPreviousConfig["key"];
 					if(key != 5345433) 
 						throw std::runtime_error("MarkovChain: error while reading config file.");
+					
+					if(exists(jPreviousConfig, "RNG")) resumed = urng_.load(jPreviousConfig["RNG"]);
 				} else 
 				{
 					for(int site = 0; site < nSite_; ++site) 
@@ -112,6 +138,9 @@ namespace Ma {
 						trace_[site] = new Tr::Trace(jNumericalParams, site, measurements, jPreviousConfig);
 				}
 			}
+			
+			if(replay_ && !resumed) 
+				throw std::runtime_error("MarkovChain: a replay needs a config file saved with the philox RNG and the same SEED");
 		}
 		/** 
 		* 
@@ -124,9 +153,13 @@ namespace Ma {
 		*		Flipping all the operators of two sites
 		*		Removing a pair of operators
 		*		Inserting a new pair of operators
+		*		Moving an operator between its neighbours, with probability PROBSHIFT (only drawn if PROBSHIFT is set, to keep the random numbers of the other updates)
 		* 
 		*/
 		void doUpdate() { 
+			Prof::Profile::Scope scope(profile_, Prof::DoUpdate);
+			profile_.bath(bath_->size());
+			
 			int const site = static_cast<int>(urng_()*nSite_);
 
 			if(urng_() < probFlip_) {
@@ -134,12 +167,18 @@ namespace Ma {
 				urng_() < .5 ? flipSpin(site) : flipSite(site, static_cast<int>(urng_()*(nSite_-1)));
 			} else {				
 				int const spin = static_cast<int>(urng_()*2);
-				++updateTot_[2*site + spin];
-
-				if(trace_[site]->operators(spin).size())
-				    urng_() < .5 ? insert(site, spin) : erase(site, spin);
-				else if(urng_() < .5) 
-					insert(site, spin);
+				
+				
+				if(probShift_ > .0 && urng_() < probShift_) {
+					if(trace_[site]->operators(spin).size()) shift(site, spin);
+				} else {
+					++updateTot_[2*site + spin];
+
+					if(trace_[site]->operators(spin).size())
+					    urng_() < .5 ? insert(site, spin) : erase(site, spin);
+					else if(urng_() < .5) 
+						insert(site, spin);
+				}
 			};
 		};
 		/** 
@@ -149,31 +188,51 @@ namespace Ma {
 		* Description: 
 		*	Saves the observables on each sites and in the bath.
 		*	We do something special for Chi the susceptibility as it is computed across sites. 
+		*	The scalar observables are measured at every call, the Green function every GREEN_EVERY_SAMPLE calls 
+		*	and Chi at the finite frequencies with Chiij every CHI_EVERY_SAMPLE calls.
 		* 
 		*/
 		void measure() {
+			Prof::Profile::Scope scope(profile_, Prof::Measure);
+			
 			int const sign = signTrace_*signBath_;
+			++samples_;
+			bool const green = samples_ % greenEvery_ == 0;
+			bool const chi = samples_ % chiEvery_ == 0;
 			
 			accSign_ += sign;
 			
 			//std::cout << sign << std::endl;
 			
 			int k = 0;
-			std::vector<std::valarray<Ut::complex> > Chiij_local(nSite_,std::valarray<Ut::complex>(0.,acc_.Chi.size()));
 			for(int site = 0; site < nSite_; ++site) {
-				Chiij_local[site] = trace_[site]->measure(sign);
+				chiSite_[site] = &trace_[site]->measure(sign, chi)[0];
 				k += (trace_[site]->operators(0).size() + trace_[site]->operators(1).size())/2;
 			};
-			for(int i = 0;i<nSite_;i++){
-				for(int j = 0;j<nSite_;j++){
-					accChiij_[std::slice((i*nSite_ + j)*acc_.Chi.size(),acc_.Chi.size(),1)] += Ut::complex(sign,0)*Chiij_local[i]*Chiij_local[j].apply(std::conj);
-				}
-			}
+			//Only the real part of Chi_i*conj(Chi_j) is stored, and it is symmetric in i and j : we accumulate i < j in place, 
+			//the lower triangle is copied in store() and the diagonal is taken from the traces
+			std::size_t const nChi = acc_.Chi.size();
+			if(chi) 
+				for(int i = 0; i < nSite_; ++i)
+					for(int j = i + 1; j < nSite_; ++j) {
+						Ut::complex const* const chiI = chiSite_[i]; Ut::complex const* const chiJ = chiSite_[j];
+						double* const acc = &accChiij_[(i*nSite_ + j)*nChi];
+						for(std::size_t n = 0; n < nChi; ++n) 
+							acc[n] += sign*(chiI[n].real()*chiJ[n].real() + chiI[n].imag()*chiJ[n].imag());
+					}
 			
 			pK_[k] += sign;
 			//std::cout << k << std::endl;
 			
-			link_.measure(sign, bath_->begin(), bath_->end());
+			if(signDiagnostics_) {
+				accSignTrace_ += signTrace_;
+				accSignBath_ += signBath_;
+				pKUnsigned_[k] += 1.;
+			}
+			
+			if(green) 
+				for(std::size_t block = 0; block < bath_->blocks(); ++block) 
+					link_.measure(sign, bath_->block(block));
 		};
 		/** 
 		* 
@@ -184,42 +243,69 @@ namespace Ma {
 		*
 		* Description: 
 		*   Stores the measurements in the handler.
+		*	The Green function and Chi at the finite frequencies are normalised by their own number of measurements (see measure())
 		*	Resets the measurements for the next round of measurements
 		* 
 		*/
 		void store(Ut::Measurements& measurements, int measurementsFromLastStore) {
+			Prof::Profile::Scope scope(profile_, Prof::Store);
+			
+			int const greenMeasurements = measurementsFromLastStore/greenEvery_;
+			int const chiMeasurements = measurementsFromLastStore/chiEvery_;
+			samples_ = 0;
 		
 			measurements["Sign"] << accSign_/measurementsFromLastStore; accSign_ = 0;
 			
 			pK_ /= measurementsFromLastStore;
 		    measurements["pK"] << pK_;
 			pK_ = .0;
+			
+			if(signDiagnostics_) {
+				measurements["SignTrace"] << accSignTrace_/measurementsFromLastStore; accSignTrace_ = .0;
+				measurements["SignBath"] << accSignBath_/measurementsFromLastStore; accSignBath_ = .0;
+				
+				pKUnsigned_ /= measurementsFromLastStore;
+				measurements["pKUnsigned"] << pKUnsigned_;
+				pKUnsigned_ = .0;
+				
+				//Numbers of accepted updates between two measurements, per update type (in the order of Prof::Move)
+				signChanges_ /= measurementsFromLastStore;
+				measurements["SignChanges"] << signChanges_;
+				signChanges_ = .0;
+				
+				negativeAccepts_ /= measurementsFromLastStore;
+				measurements["NegativeAccepts"] << negativeAccepts_;
+				negativeAccepts_ = .0;
+			}
 
 			/*****************************************************************************/
 			//The processing of the spin susceptibility is a little bit more complicated
-			std::valarray<Ut::complex> temp = accChiij_[std::slice(0,nSite_*nSite_,acc_.Chi.size())];
+			//Only i < j is accumulated in measure(), the lower triangle is the same
+			std::size_t const nChi = acc_.Chi.size();
+			for(int i = 0; i < nSite_; ++i)
+				for(int j = i + 1; j < nSite_; ++j) 
+					std::copy(&accChiij_[(i*nSite_ + j)*nChi], &accChiij_[(i*nSite_ + j)*nChi] + nChi, &accChiij_[(j*nSite_ + i)*nChi]);
+			std::valarray<double> temp = accChiij_[std::slice(0,nSite_*nSite_,acc_.Chi.size())];
 			temp /= beta_;
 			accChiij_[std::slice(0,nSite_*nSite_,acc_.Chi.size())] = temp;
-			//We need to get an array of doubles
-			for(unsigned int n=0;n<accChiij_.size();n++){
-				accChiijReal_[n] = accChiij_[n].real();
-			}
 			//As stated in Trace.h, the result is not exactly good for the same site susceptibility when there is no particles of a certain spin on the sites. We correct that here
 			for(int n=0;n<nSite_;n++){
-				accChiijReal_[std::slice((n*nSite_ + n)*acc_.Chi.size(),acc_.Chi.size(),1)] = trace_[n]->getChi();
+				accChiij_[std::slice((n*nSite_ + n)*acc_.Chi.size(),acc_.Chi.size(),1)] = trace_[n]->getChi();
+				//Chi[0] of the traces is measured at every sample
+				accChiij_[(n*nSite_ + n)*acc_.Chi.size()] *= static_cast<double>(chiMeasurements)/measurementsFromLastStore;
 			}
 			for(unsigned int n=1;n<acc_.Chi.size();n++){
-				std::valarray<double> temp = accChiijReal_[std::slice(n,nSite_*nSite_,acc_.Chi.size())];
+				std::valarray<double> temp = accChiij_[std::slice(n,nSite_*nSite_,acc_.Chi.size())];
 			        temp *= beta_/((2*n*M_PI)*(2*n*M_PI));
-				accChiijReal_[std::slice(n,nSite_*nSite_,acc_.Chi.size())] = temp;
+				accChiij_[std::slice(n,nSite_*nSite_,acc_.Chi.size())] = temp;
 			}
-			accChiijReal_ /= measurementsFromLastStore;
-			measurements["Chiij"] << accChiijReal_;
+			accChiij_ /= chiMeasurements;
+			measurements["Chiij"] << accChiij_;
 			accChiij_ = .0;
 			//End of processing of the spin susceptibility
 			/*****************************************************************************/
 
-			for(int site = 0; site < nSite_; ++site) trace_[site]->store(measurements, site, acc_, measurementsFromLastStore);
+			for(int site = 0; site < nSite_; ++site) trace_[site]->store(measurements, site, acc_, measurementsFromLastStore, chiMeasurements);
 			
 			acc_.N /= nSite_;
 			acc_.Sz /= nSite_;
@@ -241,7 +327,7 @@ namespace Ma {
 			acc_.D = .0;
 			acc_.Chi = .0;
 
-			link_.store(measurements, measurementsFromLastStore);	
+			link_.store(measurements, greenMeasurements);	
 		};
 		/** 
 		* 
@@ -250,17 +336,73 @@ namespace Ma {
 		* Description: 
 		*	Due to numerical error in the Shermann Morisson formula, we need to rebuild the entire bath matrix from time to time
 		*	Because this is an expensive operation, we don't do this operation too often
+		*	The relative difference between the updated and the rebuilt determinant, or between the updated and the rebuilt inverse 
+		*	if it is larger, is kept as a measure of this numerical error (see drift())
 		* 
 		*/
 		void cleanUpdate() { 
+			Prof::Profile::Scope scope(profile_, Prof::CleanUpdate);
+			
+			double const logDet = bath_->logDet();
 			signBath_ = bath_->rebuild(link_);
+			if(bath_->logDet() == -std::numeric_limits<double>::infinity()) 
+				throw std::runtime_error("MarkovChain::cleanUpdate: singular hybridisation matrix");
+			drift_ = std::max(std::abs(std::expm1(logDet - bath_->logDet())), bath_->drift());
+		};
+		
+		int sign() const { return signTrace_*signBath_;};
+		std::size_t order() const { return bath_->size();};
+		/* Total occupation of the sites in the current configuration (see Trace::occupation) */
+		double occupation() const {
+			double occupation = .0;
+			for(std::vector<Tr::Trace*>::const_iterator it = trace_.begin(); it != trace_.end(); ++it) occupation += (*it)->occupation();
+			return occupation;
+		};
+		double drift() const { return drift_;};
+		double det() const { return bath_->det();};
+		/* Log of the weight of the local traces for the chemical potential mu (see Tr::Trace::logWeight) */
+		double logTrace(double mu) const {
+			double logTrace = .0;
+			for(std::vector<Tr::Trace*>::const_iterator it = trace_.begin(); it != trace_.end(); ++it) logTrace += (*it)->logWeight(mu);
+			return logTrace;
+		};
+		/** 
+		* 
+		* void swapConfig(MarkovChain& other)
+		* 
+		* Parameters :	other : chain with the same hybridisation, for example at another chemical potential (see MC::Replicas)
+		*
+		* Description: 
+		*	Exchanges the configurations of the two chains. The bath matrix only depends on the operators and on the hybridisation, 
+		*	so that it is exchanged together with them, with the signs, and nothing needs to be rebuilt.
+		* 
+		*/
+		void swapConfig(MarkovChain& other) {
+			for(int site = 0; site < nSite_; ++site) trace_[site]->swapConfig(*other.trace_[site]);
+			std::swap(bath_, other.bath_);
+			std::swap(signTrace_, other.signTrace_);
+			std::swap(signBath_, other.signBath_);
+		};
+		/** 
+		* 
+		* void saveProfile(json& jJobSpecs)
+		*
+		* Description: 
+		*	Writes the profiling counters (PROFILE parameter) of all processors in the job specifications. Needs to be called by all processors.
+		* 
+		*/
+		void saveProfile(json& jJobSpecs) { 
+			profile_.save(jJobSpecs);
 		};
+		/* Processor number, followed by the chain number for the replicas, in the names of the config files (after the prefix of a batch, see Ut::Simulation) */
+		std::string name() const { return simulation_.prefix() + std::to_string(node_) + (chain_ ? "_" + std::to_string(chain_) : "");};
 		/** 
 		* 
 		* ~MarkovChain()
 		* 
 		* Description: 
 		*	Saves the current configuration in the config files to be able to resume the simulation. 
+		*	After a replay (REPLAY_SWEEPS), it goes to replay_config_<rank>.json instead, and the config file the replay started from is kept.
 		* 
 		*/
 		~MarkovChain() {
@@ -270,6 +412,7 @@ namespace Ma {
 			};
 			
 			std::cout << "Flip:  " << updateFlipAcc_/static_cast<double>(updateFlipTot_) << std::endl;
+			if(probShift_ > .0) std::cout << "Shift:  " << updateShiftAcc_/static_cast<double>(updateShiftTot_) << std::endl;
 			
 			delete bath_;	
 
@@ -282,18 +425,25 @@ namespace Ma {
 				trace_[site]->saveConfig(jConfig,site);
 				delete trace_[site];
 			};
+			if(urng_.generator() == Ut::UniformRng::Philox) urng_.save(jConfig["RNG"]);
 
-			IO::writeJsonToFile(simulation_.outputFolder() + "config_" + std::to_string(node_) + ".json",jConfig,false);		
+			//A replay keeps the config file it started from, so that it can be run again
+			IO::writeJsonToFile(simulation_.outputFolder() + (replay_ ? "replay_config_" : "config_") + name() + ".json",jConfig,false);		
 		};
 	private:
 		Ut::Simulation& simulation_;
 		int const node_;
-		Ut::EngineType rng_;
-		Ut::UniformDistribution ud_;
-		Ut::UniformRngType urng_;
+		int const chain_;
+		Ut::UniformRng urng_;
+		bool const replay_;
 		
 		double const beta_;
 		double const probFlip_;
+		double const probShift_;
+		bool const signDiagnostics_;
+		int const greenEvery_;
+		int const chiEvery_;
+		int64_t samples_;                         //Calls of measure() since the last store
 		int const nSite_;
 		
 		Link::Link link_;
@@ -305,15 +455,25 @@ namespace Ma {
 		
 		double accSign_;
 		std::valarray<double> pK_;
+		double accSignTrace_;
+		double accSignBath_;
+		std::valarray<double> pKUnsigned_;        //Only with SIGN_DIAGNOSTICS, pK_/pKUnsigned_ is the mean sign at each order
+		std::valarray<double> signChanges_;       //Only with SIGN_DIAGNOSTICS, accepted updates that changed the sign, per update type
+		std::valarray<double> negativeAccepts_;   //Only with SIGN_DIAGNOSTICS, accepted updates that lead to a negative weight, per update type
 		Tr::Meas acc_;
-		std::valarray<Ut::complex> accChiij_;//This valarray has a weird structure. It contains Chiij for all bosonic Matsubara frequencies. Sorted first by sites indices and then Matsubara frequencies.
-											//accChiij_[(i*nSite_ + j)*acc_.chi.size() + n] give Chi(i,j,i\omega_n)
-		std::valarray<double> accChiijReal_;//As we can only save real numbers, we need a second array to store it
+		std::valarray<double> accChiij_;//This valarray has a weird structure. It contains Chiij for all bosonic Matsubara frequencies. Sorted first by sites indices and then Matsubara frequencies.
+										//accChiij_[(i*nSite_ + j)*acc_.chi.size() + n] give Chi(i,j,i\omega_n), only its real part is kept
+		std::vector<Ut::complex const*> chiSite_;//Fourier transforms of Sz on every site, owned by the traces (see Tr::Trace::measure)
 		
 		std::vector<double> updateAcc_;
 		std::vector<double> updateTot_;
 		int updateFlipAcc_;
 		int updateFlipTot_;
+		int updateShiftAcc_;
+		int updateShiftTot_;
+		
+		Prof::Profile profile_;
+		double drift_;
 			
 		/** 
 		* 
@@ -325,21 +485,30 @@ namespace Ma {
 		* Description:
 		*   Tries to insert a new pair of operators in the imaginary time line
 		*	Accepts or reject the insertion according to the Metropolis Hastings acceptation rate.
+		*	The random number is drawn before the bath part, which is first bounded in O(N) (see Ba::Bath::insertBound). The decisions are the same as with the exact ratio.
 		* 
 		*/
 		void insert(int site, int spin) {
 			Tr::Trace& trace = *trace_[site];
 			Ba::Bath& bath = *bath_;
 				
-			double prob = .0;
-			prob += trace.insert(spin, urng_);
-			prob += bath.insert(site, spin, trace.op().time(), trace.op().ptr(), trace.opDagg().time(), trace.opDagg().ptr(), link_);
+			profile_.propose(Prof::Insert);
+			
+			double const prob = trace.insert(spin, urng_);
+			double const logRand = std::log(1. - urng_());
+			
+			//The O(N^2) part of the bath is only computed if the proposal is not already rejected with the bound of the determinant ratio
+			bool const bound = logRand < prob + bath.insertBound(site, spin, trace.op().time(), trace.op().ptr(), trace.opDagg().time(), trace.opDagg().ptr(), link_);
+			if(!bound) profile_.bound(Prof::Insert);
 
-			if(std::log(1. - urng_()) < prob) { 
+			if(bound && logRand < prob + bath.insertRatio()) { 
+				int const previous = sign();
 				signTrace_ *= trace_[site]->acceptInsert(spin);
 			    signBath_ *= bath.acceptInsert();
+				signAccepted(Prof::Insert, previous);
 
 				++updateAcc_[2*site + spin];
+				profile_.accept(Prof::Insert);
 				
 				return;
 			}
@@ -362,15 +531,20 @@ namespace Ma {
 			Tr::Trace& trace = *trace_[site];
 			Ba::Bath& bath = *bath_;
 
+			profile_.propose(Prof::Erase);
+			
 			double prob = .0;
 			prob += trace.erase(spin, urng_);			
 			prob += bath.erase(site, spin, trace.op().time(), trace.opDagg().time());
 			
 			if(std::log(1. - urng_()) < prob) { 
+				int const previous = sign();
 				signTrace_ *= trace_[site]->acceptErase(spin);
 				signBath_ *= bath.acceptErase();
+				signAccepted(Prof::Erase, previous);
 
 				++updateAcc_[2*site + spin];
+				profile_.accept(Prof::Erase);
 							
 				return;
 			}
@@ -379,6 +553,43 @@ namespace Ma {
 		};
 		/** 
 		* 
+		* void shift(int site, int spin)
+		* 
+		* Parameters :	site : site number
+		*				spin : spin
+		*
+		* Description: 
+		*   Tries to move an operator of the imaginary time line between its neighbours.
+		*	The bath matrix is updated by replacing a row or a column of the hybridisation matrix.
+		* 
+		*/
+		void shift(int site, int spin) {
+			Tr::Trace& trace = *trace_[site];
+			Ba::Bath& bath = *bath_;
+			
+			profile_.propose(Prof::Shift);
+			++updateShiftTot_;
+			
+			double prob = .0;
+			prob += trace.shift(spin, urng_);
+			prob += bath.shift(site, spin, trace.op().type(), trace.op().time(), trace.opShift().time(), trace.opShift().ptr(), link_);
+			
+			if(std::log(1. - urng_()) < prob) {
+				int const previous = sign();
+				signTrace_ *= trace.acceptShift(spin);
+				signBath_ *= bath.acceptShift();
+				signAccepted(Prof::Shift, previous);
+				
+				++updateShiftAcc_;
+				profile_.accept(Prof::Shift);
+				
+				return;
+			}
+			
+			trace.rejectShift(spin);
+		};
+		/** 
+		* 
 		* void flipSpin(int site)
 		* 
 		* Parameters :	site : site number
@@ -389,8 +600,14 @@ namespace Ma {
 		* 
 		*/
 		void flipSpin(int site) {
+			profile_.propose(Prof::SpinFlip);
+			int const previous = sign();
+			
 		    trace_[site]->flip();
-		    if(!tryFlip()) trace_[site]->flip();
+		    if(!tryFlip()) trace_[site]->flip(); else {
+				profile_.accept(Prof::SpinFlip);
+				signAccepted(Prof::SpinFlip, previous);
+			}
 		};
 		/** 
 		* 
@@ -409,8 +626,31 @@ namespace Ma {
 			if(siteA == siteB){
 				siteB = nSite_-1;
 			}
+			profile_.propose(Prof::SiteFlip);
+			int const previous = sign();
+			
 			std::swap(trace_[siteA], trace_[siteB]);
-			if(!tryFlip()) std::swap(trace_[siteA], trace_[siteB]);
+			if(!tryFlip()) std::swap(trace_[siteA], trace_[siteB]); else {
+				profile_.accept(Prof::SiteFlip);
+				signAccepted(Prof::SiteFlip, previous);
+			}
+		};
+		/** 
+		* 
+		* void signAccepted(Prof::Move move, int previous)
+		* 
+		* Parameters :	move : type of the accepted update
+		*				previous : sign of the configuration before the update
+		*
+		* Description: 
+		*  	Counts, with SIGN_DIAGNOSTICS, whether the accepted update changed the sign and whether it lead to a negative weight.
+		* 
+		*/
+		void signAccepted(Prof::Move move, int previous) {
+			if(signDiagnostics_) {
+				if(sign() != previous) ++signChanges_[move];
+				if(sign() < 0) ++negativeAccepts_[move];
+			}
 		};
 		
 
@@ -422,7 +662,8 @@ namespace Ma {
 		*				 returns 0 if the flip is not accepted  
 		* Description: 
 		*	Fills new bath with the flipped operators
-		*  	Computes the Metropolis Hastings Acceptation rate for the flip using the old and the new baths.
+		*  	Computes the Metropolis Hastings Acceptation rate for the flip using the old and the new baths, from the difference of their log|det|.
+		*	A singular new bath has log|det| = -inf (see Ba::Block::rebuild), so that the flip is rejected.
 		* 	The flip procedure needs a cleanUdpate of the bath matrix and is therefore pretty expensive
 		*	In case the flip is accepted : 
 		*		the new bath matrices are updated with their new values (rebuild)
@@ -431,7 +672,9 @@ namespace Ma {
 		*
 		*/
 		int tryFlip() {
-			Ba::Bath* newBath = new Ba::Bath();
+			Prof::Profile::Scope scope(profile_, Prof::TryFlip);
+			
+			Ba::Bath* newBath = new Ba::Bath(link_.blocks());
 			
 			for(int site = 0; site < nSite_; ++site) {
 				Tr::Trace& trace = *trace_[site];
@@ -443,7 +686,7 @@ namespace Ma {
 		
 			newBath->rebuild(link_);
 		
-			if(urng_() < std::abs(newBath->det()/bath_->det())) {
+			if(urng_() < std::exp(newBath->logDet() - bath_->logDet())) {
 				//We accept the new bath and get rid of the old bath
 				signTrace_ = 1;
 				for(std::vector<Tr::Trace*>::iterator it = trace_.begin(); it != trace_.end(); ++it)
@@ -451,7 +694,7 @@ namespace Ma {
 				
 				delete bath_; bath_ = newBath;
 				
-				signBath_ = bath_->det() > .0 ? 1 : -1;
+				signBath_ = bath_->sign();
 				
 				++updateFlipAcc_;
 				
@@ -2,6 +2,9 @@
 #define __MONTECARLO
 
 #include <ctime>
+#include <chrono>
+#include <memory>
+#include <limits>
 #include "MarkovChain.h"
 
 #ifdef HAVE_CHRONO
@@ -21,6 +24,9 @@ namespace MC {
 		bool end() {
 			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_).count() > duration_;
 		};
+		double elapsed() {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+		};
 	private:
 		double duration_;
 		std::chrono::steady_clock::time_point start_;
@@ -36,6 +42,9 @@ namespace MC {
 		bool end() {
 			return std::difftime(std::time(NULL), start_) > duration_;
 		};
+		double elapsed() {
+			return std::difftime(std::time(NULL), start_);
+		};
 	private:
 		double duration_;
 		std::time_t start_;
@@ -44,9 +53,518 @@ namespace MC {
 #endif
 	/** 
 	* 
-	* void MonteCarlo(Ma::MarkovChain& markovchain, Ut::Simulation& simulation)
+	* struct Intervals
+	* 
+	* Description: 
+	*	Chooses SAMPLE_EVERY_SWEEP and CLEAN_EVERY_SWEEP on every processor from the second half of the thermalization (ADAPTIVE_INTERVALS parameter).
+	*	The measurement interval is twice the largest integrated autocorrelation time of the expansion order and of the sign, in sweeps,
+	*	so that successive measurements are nearly independent.
+	*	The clean interval is the number of sweeps after which the relative error of the bath determinant reaches CLEAN_TOLERANCE (1e-10 by default),
+	*	with the error per sweep measured at every clean. It is at most ten times the CLEAN_EVERY_SWEEP of the parameters.
+	*	An interval is left unchanged if the second half of the thermalization is too short to estimate it.
+	*/
+	struct Intervals {
+		Intervals(json const& jParams) : 
+		on_(exists(jParams, "ADAPTIVE_INTERVALS") && jParams["ADAPTIVE_INTERVALS"].get<bool>()),
+		tolerance_(exists(jParams, "CLEAN_TOLERANCE") ? jParams["CLEAN_TOLERANCE"].get<double>() : 1.e-10),
+		recording_(false), drift_(.0), cleans_(0) {
+		};
+		
+		bool on() const { return on_;};
+		bool recording() const { return recording_;};
+		void start() { recording_ = true;};
+		
+		void add(std::size_t order, int sign) { k_.add(order); sign_.add(sign);};
+		void drift(double drift, int64_t sweeps) { drift_ += drift/sweeps; ++cleans_;};
+		/** 
+		* 
+		* void choose(int64_t& sample_every_sweep, int64_t& clean_every_sweep, json& jJobSpecs)
+		* 
+		* Description: 
+		*	Sets the intervals and writes their mean over the processors, together with the estimates they are based on, in the job specifications.
+		*	Needs to be called by all processors.
+		*/
+		void choose(int64_t& sample_every_sweep, int64_t& clean_every_sweep, json& jJobSpecs) {
+			double const tau = std::max(k_.tau(), sign_.tau());
+			if(k_.size() >= minSweeps) sample_every_sweep = std::max<int64_t>(1, std::ceil(2.*tau));
+			
+			double const drift = cleans_ ? drift_/cleans_ : .0;
+			int64_t const max_clean = 10*clean_every_sweep;
+			if(cleans_) clean_every_sweep = drift > .0 ? std::max<int64_t>(1, std::min<double>(max_clean, tolerance_/drift)) : max_clean;
+			
+			std::valarray<double> values = { static_cast<double>(sample_every_sweep), static_cast<double>(clean_every_sweep), k_.tau(), sign_.tau(), drift }; 
+			std::valarray<double> accValues(.0, values.size());
+			mpi::reduce(values, accValues);
+			
+			if(mpi::rank() == mpi::master) {
+				accValues /= mpi::number_of_workers();
+				json& jIntervals = jJobSpecs["Adaptive Intervals"];
+				jIntervals["Sample Every Sweep"] = accValues[0];
+				jIntervals["Clean Every Sweep"] = accValues[1];
+				jIntervals["Autocorrelation Time k"] = accValues[2];
+				jIntervals["Autocorrelation Time Sign"] = accValues[3];
+				jIntervals["Determinant Drift per Sweep"] = accValues[4];
+			}
+		};
+	private:
+		static uint64_t const minSweeps = 1024;
+		
+		bool const on_;
+		double const tolerance_;
+		bool recording_;
+		
+		Ut::Autocorrelation k_;
+		Ut::Autocorrelation sign_;
+		double drift_;
+		int cleans_;
+	};
+	/** 
+	* 
+	* struct Equilibration
+	* 
+	* Description: 
+	*	Ends the thermalization of a processor as soon as its chain is stationary (EQUILIBRATION parameter), THERMALIZATION_TIME is then an upper bound.
+	*	The expansion order, the sign and the occupation are sampled every SAMPLE_EVERY_SWEEP sweeps and averaged in batches of samples.
+	*	For every series of batch means, the MSER truncation point d minimises the squared standard error of the mean of the batches after d, 
+	*	with d in the first half of the series. A strong trend puts the minimum at the end of this range. As MSER alone lets weaker trends through,
+	*	the means of the two halves of the batches after d also need to agree within two standard errors (as in the Geweke diagnostic).
+	*	The chain is considered stationary when the three series pass both tests. There need to be minBatches batches, and neighbouring batches 
+	*	are merged when there are maxBatches of them, so that the memory and the cost of a test stay bounded.
+	*	The time left by the thermalization goes to the measurements.
+	*/
+	struct Equilibration {
+		Equilibration(json const& jParams) : 
+		on_(exists(jParams, "EQUILIBRATION") && jParams["EQUILIBRATION"].get<bool>()),
+		batchSize_(5), samples_(0), series_(3), sum_(3, .0), equilibrated_(false), minutes_(.0) {
+		};
+		
+		bool on() const { return on_;};
+		bool equilibrated() const { return equilibrated_;};
+		/* Adds a sample of the chain, returns true if the chain is stationary */
+		bool add(double order, double sign, double occupation) {
+			double const values[] = { order, sign, occupation };
+			for(std::size_t k = 0; k < series_.size(); ++k) sum_[k] += values[k];
+			if(++samples_ < batchSize_) return false;
+			
+			for(std::size_t k = 0; k < series_.size(); ++k) {
+				series_[k].push_back(sum_[k]/batchSize_); sum_[k] = .0;
+			}
+			samples_ = 0;
+			
+			if(series_[0].size() == maxBatches) {
+				for(auto& batches : series_) {
+					for(std::size_t i = 0; i < maxBatches/2; ++i) batches[i] = .5*(batches[2*i] + batches[2*i + 1]);
+					batches.resize(maxBatches/2);
+				}
+				batchSize_ *= 2;
+			}
+			
+			if(series_[0].size() < minBatches) return false;
+			for(auto const& batches : series_) 
+				if(!stationary(batches)) return false;
+			return equilibrated_ = true;
+		};
+		/* Records the duration of the thermalization, in seconds */
+		void stop(double seconds) { minutes_ = seconds/60.;};
+		/** 
+		* 
+		* void save(json& jJobSpecs)
+		* 
+		* Description: 
+		*	Writes the number of equilibrated processors and their mean thermalization time in the job specifications. Needs to be called by all processors.
+		*/
+		void save(json& jJobSpecs) {
+			if(!on_) return;
+			
+			std::valarray<double> values = { equilibrated_ ? 1. : .0, minutes_ };
+			std::valarray<double> accValues(.0, values.size());
+			mpi::reduce(values, accValues);
+			
+			if(mpi::rank() == mpi::master) {
+				jJobSpecs["Equilibration"]["Equilibrated Processors"] = accValues[0];
+				jJobSpecs["Equilibration"]["Thermalization Minutes per Processor"] = accValues[1]/mpi::number_of_workers();
+			}
+		};
+	private:
+		static std::size_t const minBatches = 32;
+		static std::size_t const maxBatches = 1024;
+		
+		bool const on_;
+		int64_t batchSize_;
+		int64_t samples_;
+		std::vector<std::vector<double>> series_;
+		std::vector<double> sum_;
+		bool equilibrated_;
+		double minutes_;
+		
+		/* MSER truncation, with the sums over the batches after d added from the end of the series, followed by the comparison of the two halves */
+		static bool stationary(std::vector<double> const& batches) {
+			std::size_t const half = batches.size()/2;
+			double sum = .0, sum2 = .0;
+			double min = std::numeric_limits<double>::max(); std::size_t argMin = half;
+			for(std::size_t d = batches.size(); d-- > 0;) {
+				sum += batches[d]; sum2 += batches[d]*batches[d];
+				if(d > half) continue;
+				
+				double const n = batches.size() - d;
+				double const mser = std::max(.0, sum2 - sum*sum/n)/(n*n);
+				if(mser <= min) { min = mser; argMin = d;}
+			}
+			if(argMin >= half) return false;
+			
+			std::size_t const middle = argMin + (batches.size() - argMin)/2;
+			double meanA, errorA, meanB, errorB;
+			meanError(batches.data() + argMin, middle - argMin, meanA, errorA);
+			meanError(batches.data() + middle, batches.size() - middle, meanB, errorB);
+			return std::abs(meanA - meanB) <= 2.*std::sqrt(errorA + errorB);
+		};
+		/* Mean of n batches and its squared standard error */
+		static void meanError(double const* batches, std::size_t n, double& mean, double& error) {
+			mean = .0; for(std::size_t i = 0; i < n; ++i) mean += batches[i]; mean /= n;
+			error = .0; for(std::size_t i = 0; i < n; ++i) error += (batches[i] - mean)*(batches[i] - mean); error /= (n - 1.)*n;
+		};
+	};
+	/** 
+	* 
+	* struct Replicas
+	* 
+	* Description: 
+	*	Replica exchange in the chemical potential (REPLICA_MU parameter), against the slow mixing of the occupation sectors at low temperature and large U.
+	*	Next to the chain of the simulation, every processor runs one chain for every other chemical potential of the ladder REPLICA_MU, with the same 
+	*	hybridisation. They do the same sweeps and cleans, and every REPLICA_EXCHANGE_EVERY_SWEEP sweeps the configurations of neighbouring chemical 
+	*	potentials are exchanged with the Metropolis probability given by the local traces (see Tr::Trace::logWeight), alternately for the even and the odd pairs. 
+	*	The bath matrix only depends on the operators and on the hybridisation, so that it goes with the configuration (see Ma::MarkovChain::swapConfig).
+	*	Only the chain of the simulation, at mu, measures. The other ones keep their own config files (config_<rank>_<chain>.json).
+	*/
+	struct Replicas {
+		Replicas(Ma::MarkovChain& markovChain, json const& jParams, Hyb::MatsubaraMap const& hyb, json const& jLink, Ut::Simulation& simulation) : 
+		on_(exists(jParams, "REPLICA_MU")),
+		exchangeEvery_(exists(jParams, "REPLICA_EXCHANGE_EVERY_SWEEP") ? jParams["REPLICA_EXCHANGE_EVERY_SWEEP"].get<int64_t>() : 1),
+		urng_(jParams, mpi::rank(), -1),   //Its own stream, apart from those of the chains (0 and above)
+		sweeps_(0) {
+			if(!on_) return;
+			
+			mu_ = jParams["REPLICA_MU"].get<std::vector<double>>();
+			std::sort(mu_.begin(), mu_.end());
+			
+			std::vector<double>::const_iterator const it = std::find(mu_.begin(), mu_.end(), jParams["mu"].get<double>());
+			if(it == mu_.end()) throw std::runtime_error("MC::Replicas: REPLICA_MU needs to contain mu");
+			if(exchangeEvery_ < 1) throw std::runtime_error("MC::Replicas: REPLICA_EXCHANGE_EVERY_SWEEP needs to be positive");
+			
+			std::size_t const target = it - mu_.begin();
+			for(std::size_t n = 0; n < mu_.size(); ++n) {
+				if(n == target) { chains_.push_back(&markovChain); continue;}
+				
+				//The replicas register their observables in a copy of the simulation, which is never saved
+				json jReplica = jParams; jReplica["mu"] = mu_[n];
+				simulations_.emplace_back(new Ut::Simulation(simulation));
+				replicas_.emplace_back(new Ma::MarkovChain(jReplica, hyb, jLink, *simulations_.back(), n + 1));
+				chains_.push_back(replicas_.back().get());
+			}
+			
+			proposed_.resize(mu_.size() - 1, 0); accepted_.resize(mu_.size() - 1, 0);
+			mpi::cout << "Replica exchange between " << mu_.size() << " chemical potentials" << std::endl;
+		};
+		
+		bool on() const { return on_;};
+		
+		void doUpdate() {
+			for(auto& replica : replicas_) replica->doUpdate();
+			
+			if(on_ && ++sweeps_ % exchangeEvery_ == 0) exchange((sweeps_/exchangeEvery_)%2);
+		};
+		void cleanUpdate() {
+			for(auto& replica : replicas_) replica->cleanUpdate();
+		};
+		/** 
+		* 
+		* void save(json& jJobSpecs)
+		* 
+		* Description: 
+		*	Writes the ladder and the acceptance rate of the exchanges of every pair of neighbours, summed over the processors, in the job specifications. 
+		*	Needs to be called by all processors.
+		*/
+		void save(json& jJobSpecs) {
+			if(!on_) return;
+			
+			std::vector<uint64_t> proposed(proposed_.size()), accepted(accepted_.size());
+			mpi::reduce(proposed_, proposed);
+			mpi::reduce(accepted_, accepted);
+			
+			if(mpi::rank() == mpi::master) {
+				json& jReplicas = jJobSpecs["Replica Exchange"];
+				jReplicas["Chemical Potentials"] = mu_;
+				for(std::size_t n = 0; n < proposed.size(); ++n) 
+					jReplicas["Acceptance Rates"].push_back(proposed[n] ? accepted[n]/static_cast<double>(proposed[n]) : .0);
+			}
+		};
+	private:
+		bool const on_;
+		int64_t const exchangeEvery_;
+		Ut::UniformRng urng_;
+		int64_t sweeps_;
+		
+		std::vector<double> mu_;                                   //Ladder of the chemical potentials, in increasing order
+		std::vector<Ma::MarkovChain*> chains_;                     //Chain of every chemical potential, the one of the simulation included
+		std::vector<std::unique_ptr<Ut::Simulation>> simulations_;
+		std::vector<std::unique_ptr<Ma::MarkovChain>> replicas_;
+		std::vector<uint64_t> proposed_;
+		std::vector<uint64_t> accepted_;
+		
+		/* Tries to exchange the configurations of the pairs (n, n + 1) with n of the given parity */
+		void exchange(int parity) {
+			for(std::size_t n = parity; n + 1 < chains_.size(); n += 2) {
+				Ma::MarkovChain& lower = *chains_[n]; Ma::MarkovChain& upper = *chains_[n + 1];
+				double const logRatio = lower.logTrace(mu_[n + 1]) + upper.logTrace(mu_[n]) - lower.logTrace(mu_[n]) - upper.logTrace(mu_[n + 1]);
+				
+				++proposed_[n];
+				if(urng_() < std::exp(logRatio)) {
+					lower.swapConfig(upper);
+					++accepted_[n];
+				}
+			}
+		};
+	};
+	/** 
+	* 
+	* struct Termination
+	* 
+	* Description: 
+	*	Coordinated end of the measurements (COORDINATED_STOP or ERROR_TARGET parameters). 
+	*	At every store, the processors add up their number of measurements, whether their MEASUREMENT_TIME is over and the binning state of the 
+	*	observables of ERROR_TARGET with a non blocking sum, and go on measuring while it is pending. As all processors read the same sums, 
+	*	they all stop after the same exchange : when the total number of measurements reaches MEASUREMENTS (if given), when the relative errors 
+	*	of all the observables of ERROR_TARGET are below their target, or when the time of one processor is over.
+	*	The processors then reach the collectives of the save at about the same time.
+	*/
+	struct Termination {
+		Termination(json const& jParams) : 
+		on_((exists(jParams, "COORDINATED_STOP") && jParams["COORDINATED_STOP"].get<bool>()) || exists(jParams, "ERROR_TARGET")),
+		target_(exists(jParams, "MEASUREMENTS") ? jParams["MEASUREMENTS"].get<double>() : .0),
+		stores_(0) {
+			if(exists(jParams, "ERROR_TARGET")) {
+				int const entries = exists(jParams, "ERROR_TARGET_ENTRIES") ? jParams["ERROR_TARGET_ENTRIES"].get<int>() : 1;
+				for(auto const& el : jParams["ERROR_TARGET"].items()) 
+					for(int n = 0; n < entries; ++n) 
+						errorTargets_.push_back(ErrorTarget{ el.key(), n, el.value().get<double>(), -1.});
+			}
+			progress_.reset(new mpi::IAllReduce(2 + 3*levels*errorTargets_.size()));
+		};
+		
+		bool on() const { return on_;};
+		/** 
+		* 
+		* bool done(int64_t nMeasurements, bool timeOver, Ut::Measurements const& measurements, json& jJobSpecs)
+		* 
+		* Parameters :	nMeasurements : number of measurements of the processor
+		*				timeOver : whether the MEASUREMENT_TIME of the processor is over
+		*				measurements : the stored measurements, for the error targets
+		*				jJobSpecs : job specifications, the reason of the stop is written in it
+		* 
+		* Return Value : true if all processors stop now
+		*/
+		bool done(int64_t nMeasurements, bool timeOver, Ut::Measurements const& measurements, json& jJobSpecs) {
+			//Every processor needs two stores for the error estimate, so the first exchange is only posted at the second one
+			if(++stores_ < 2) return false;
+			
+			if(progress_->test()) {
+				std::vector<double> const& total = progress_->result();
+				bool const errorsReached = errorTargets_.size() && this->errorsReached(total.data() + 2);
+				
+				std::string reason;
+				if(target_ > .0 && total[0] >= target_) reason = "Measurements";
+				else if(errorsReached) reason = "Error Target";
+				else if(total[1] > .0) reason = "Measurement Time";
+				
+				if(reason.size()) {
+					if(mpi::rank() == mpi::master) {
+						jJobSpecs["Termination"]["Reason"] = reason;
+						jJobSpecs["Termination"]["Measurements"] = total[0];
+						for(auto const& errorTarget : errorTargets_) 
+							if(errorTarget.error >= .0 && errorTarget.error < std::numeric_limits<double>::max()) jJobSpecs["Termination"]["Relative Errors"][errorTarget.name].push_back(errorTarget.error);
+					}
+					return true;
+				}
+			}
+			
+			if(!progress_->pending()) {
+				std::vector<double> progress(2 + 3*levels*errorTargets_.size(), .0);
+				progress[0] = nMeasurements; progress[1] = timeOver ? 1. : .0;
+				for(std::size_t i = 0; i < errorTargets_.size(); ++i) {
+					Ut::Measurements::const_iterator it = measurements.find(errorTargets_[i].name);
+					if(it == measurements.end()) throw std::runtime_error("MonteCarlo: observable " + errorTargets_[i].name + " of ERROR_TARGET not found.");
+					it->second.binning(errorTargets_[i].entry, levels, progress.data() + 2 + 3*levels*i);
+				}
+				progress_->start(progress);
+			}
+			
+			return false;
+		};
+	private:
+		struct ErrorTarget { std::string name; int entry; double target; double error;};
+		
+		static std::size_t const levels = 32;  //Binning levels exchanged
+		static double constexpr minBins = 64;  //Minimal number of bins for the error of a binning level to be considered
+		static std::size_t const minLevels = 4;
+		
+		bool const on_;
+		double const target_;
+		int64_t stores_;
+		std::vector<ErrorTarget> errorTargets_;
+		std::unique_ptr<mpi::IAllReduce> progress_;
+		/* 
+		* bool errorsReached(double const* binning)
+		* 
+		* Description: 
+		*	Computes the relative error of every error target from the binning state summed over the processors.
+		*	As in Observable::reduce, the error is the largest over the binning levels, here over those with at least minBins bins. 
+		*	There need to be minLevels such levels, otherwise the correlations are not resolved and the target is not considered reached.
+		*	It is therefore somewhat lower than the error in the output, which also includes the deeper levels and the spread between the processors.
+		*	Entries beyond the size of an observable are ignored.
+		*/
+		bool errorsReached(double const* binning) {
+			bool reached = true;
+			for(auto& errorTarget : errorTargets_) {
+				double const* levelsOf = binning; binning += 3*levels;
+				if(levelsOf[0] == .0) continue;
+				
+				double const mean = levelsOf[1]/levelsOf[0];
+				double error = .0; std::size_t filledLevels = 0;
+				for(std::size_t l = 0; l < levels; ++l) {
+					double const bins = levelsOf[3*l];
+					if(bins < minBins) continue;
+					
+					double const binMean = levelsOf[3*l + 1]/(bins*static_cast<double>(uint64_t(1) << l));
+					double const variance = std::max(.0, levelsOf[3*l + 2]/bins - binMean*binMean);
+					error = std::max(error, std::sqrt(variance/(bins - 1.)));
+					++filledLevels;
+				}
+				
+				errorTarget.error = filledLevels >= minLevels && mean != .0 ? error/std::abs(mean) : std::numeric_limits<double>::max();
+				if(errorTarget.error > errorTarget.target) reached = false;
+			}
+			return reached;
+		};
+	};
+	/** 
+	* 
+	* struct FixedWork
+	* 
+	* Description: 
+	*	Fixed work mode (THERMALIZATION_SWEEPS and MEASUREMENT_SWEEPS parameters), to compare builds on the same work : the thermalization and the 
+	*	measurements run for numbers of sweeps instead of THERMALIZATION_TIME and MEASUREMENT_TIME. The measurements end at the first store after 
+	*	MEASUREMENT_SWEEPS sweeps, so that no measurement is lost.
+	*	Records the duration of both phases (with the steady clock, whatever HAVE_CHRONO) and the largest bath matrix, and writes the rates in the job specifications.
+	*/
+	struct FixedWork {
+		FixedWork(json const& jParams) : 
+		on_(exists(jParams, "THERMALIZATION_SWEEPS") || exists(jParams, "MEASUREMENT_SWEEPS")),
+		thermalizationSweeps_(0), measurementSweeps_(0), seconds_(2, .0), phase_(0), peak_(0) {
+			if(!on_) return;
+			
+			if(!exists(jParams, "THERMALIZATION_SWEEPS") || !exists(jParams, "MEASUREMENT_SWEEPS")) 
+				throw std::runtime_error("MC::FixedWork: THERMALIZATION_SWEEPS and MEASUREMENT_SWEEPS go together");
+			thermalizationSweeps_ = jParams["THERMALIZATION_SWEEPS"];
+			measurementSweeps_ = jParams["MEASUREMENT_SWEEPS"];
+			if(thermalizationSweeps_ < 0 || measurementSweeps_ < 1) throw std::runtime_error("MC::FixedWork: wrong numbers of sweeps");
+		};
+		
+		bool on() const { return on_;};
+		int64_t thermalizationSweeps() const { return thermalizationSweeps_;};
+		int64_t measurementSweeps() const { return measurementSweeps_;};
+		
+		void add(std::size_t order) { peak_ = std::max<uint64_t>(peak_, order);};
+		/* Starts the clock of the next phase, the thermalization first and then the measurements */
+		void start() { start_ = std::chrono::steady_clock::now();};
+		void stop() { seconds_[phase_++] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();};
+		/** 
+		* 
+		* void save(int64_t thermalization_sweeps, int64_t measurement_sweeps, int64_t measurements, json& jJobSpecs)
+		* 
+		* Description: 
+		*	Writes the numbers of sweeps and of measurements, the seconds of both phases, the sweeps and the measurements per second (all per processor, 
+		*	averaged over the processors) and the largest bath matrix of all processors in the job specifications. Needs to be called by all processors.
+		*/
+		void save(int64_t thermalization_sweeps, int64_t measurement_sweeps, int64_t measurements, json& jJobSpecs) {
+			if(!on_) return;
+			
+			std::valarray<double> values = { 
+				static_cast<double>(thermalization_sweeps), static_cast<double>(measurement_sweeps), static_cast<double>(measurements), seconds_[0], seconds_[1],
+				(thermalization_sweeps + measurement_sweeps)/(seconds_[0] + seconds_[1]), measurements/seconds_[1] 
+			};
+			std::valarray<double> accValues(.0, values.size());
+			mpi::reduce(values, accValues);
+			uint64_t peak = 0; mpi::getMax(peak_, peak);
+			
+			if(mpi::rank() == mpi::master) {
+				accValues /= mpi::number_of_workers();
+				json& jFixedWork = jJobSpecs["Fixed Work"];
+				jFixedWork["Thermalization Sweeps"] = accValues[0];
+				jFixedWork["Measurement Sweeps"] = accValues[1];
+				jFixedWork["Measurements"] = accValues[2];
+				jFixedWork["Thermalization Seconds"] = accValues[3];
+				jFixedWork["Measurement Seconds"] = accValues[4];
+				jFixedWork["Sweeps per Second"] = accValues[5];
+				jFixedWork["Measurements per Second"] = accValues[6];
+				jFixedWork["Peak Bath Size"] = peak;
+			}
+		};
+	private:
+		bool const on_;
+		int64_t thermalizationSweeps_;
+		int64_t measurementSweeps_;
+		
+		std::vector<double> seconds_;
+		int phase_;
+		std::chrono::steady_clock::time_point start_;
+		uint64_t peak_;
+	};
+	/** 
+	* 
+	* void Replay(Ma::MarkovChain& markovChain, Ut::Simulation& simulation)
+	* 
+	* Parameters :	markovChain : markov chain resumed from a config file written with the philox RNG
+	*				simulation : Object used to store the parameters and the measurements throughout the simulation
+	* 
+	* Description: 
+	*   Runs REPLAY_SWEEPS sweeps from the configuration and the random number stream of the config file, cleaning every CLEAN_EVERY_SWEEP sweeps, without measurements.
+	*	The expansion order, the sign and the bath determinant after every sweep are written to replay_<rank>.json.
+	*	Two replays from the same config file give the same trajectory, unless the code of the Markov chain changed in between, which is what it is meant to check.
+	*/
+	void Replay(Ma::MarkovChain& markovChain, Ut::Simulation& simulation) 
+	{
+		json const& jParams = simulation.params();
+		int64_t const replay_sweeps = jParams["REPLAY_SWEEPS"];
+		int64_t const clean_every_sweep = jParams["CLEAN_EVERY_SWEEP"];
+		
+		std::vector<std::size_t> order; order.reserve(replay_sweeps);
+		std::vector<int> sign; sign.reserve(replay_sweeps);
+		std::vector<double> det; det.reserve(replay_sweeps);
+		
+		for(int64_t sweep = 1; sweep <= replay_sweeps; ++sweep) {
+			markovChain.doUpdate();
+			
+			if(sweep % clean_every_sweep == 0) 
+				markovChain.cleanUpdate();
+			
+			order.push_back(markovChain.order());
+			sign.push_back(markovChain.sign());
+			det.push_back(markovChain.det());
+		}
+		
+		json jReplay;
+		jReplay["Sweeps"] = replay_sweeps;
+		jReplay["Order"] = order;
+		jReplay["Sign"] = sign;
+		jReplay["Determinant"] = det;
+		IO::writeJsonToFile(simulation.outputFolder() + "replay_" + markovChain.name() + ".json", jReplay, false);
+	};
+	/** 
+	* 
+	* void MonteCarlo(Ma::MarkovChain& markovchain, Replicas& replicas, Ut::Simulation& simulation)
 	* 
 	* Parameters :	markovchain : initialized markovchain, the one that does all the job
+	*				replicas : chains at the other chemical potentials of REPLICA_MU, updated and exchanged along with markovchain (see Replicas)
 	*				simulation : Object used to store the parameters and the measurements throughout the simulation
 	* 
 	* Return Value : Nothing 
@@ -57,64 +575,115 @@ namespace MC {
 	* 
 	*    The MonteCarlo Function is the engine of the QMC Simulation
 	*    It allows to monitor the number of sweeps, measurements and storing points throughout the simulation.
+	*    With the REPLAY_SWEEPS parameter, it only replays the markov chain (see Replay).
+	*    With THERMALIZATION_SWEEPS and MEASUREMENT_SWEEPS, it runs for numbers of sweeps instead of times (see FixedWork).
 	* 
 	*/
-	void MonteCarlo(Ma::MarkovChain& markovChain, Ut::Simulation& simulation) //Lauching the program
+	void MonteCarlo(Ma::MarkovChain& markovChain, Replicas& replicas, Ut::Simulation& simulation) //Lauching the program
 	{	
 		std::time_t time;
 		Timer timer;
+		Timer adaptiveTimer;
 		
 		int64_t thermalization_sweeps = 0;
 		int64_t measurement_sweeps = 0;
 		int64_t measurementsFromLastSample = 0;
 
 		json const& jParams = simulation.params();		
-		int64_t const clean_every_sweep = jParams["CLEAN_EVERY_SWEEP"];
-		int64_t const sample_every_sweep = jParams["SAMPLE_EVERY_SWEEP"];
+		if(exists(jParams, "REPLAY_SWEEPS")) {
+			mpi::cout << "Replay " << jParams["REPLAY_SWEEPS"] << " sweeps" << std::endl;
+			Replay(markovChain, simulation);
+			return;
+		}
+		int64_t clean_every_sweep = jParams["CLEAN_EVERY_SWEEP"];
+		int64_t sample_every_sweep = jParams["SAMPLE_EVERY_SWEEP"];
 		int64_t const store_every_sample = jParams["STORE_EVERY_SAMPLE"];
-		double const thermalization_time = jParams["THERMALIZATION_TIME"];
-		double const measurement_time = jParams["MEASUREMENT_TIME"];
+		FixedWork fixedWork(jParams);
+		double const thermalization_time = fixedWork.on() ? .0 : jParams["THERMALIZATION_TIME"].get<double>();
+		double const measurement_time = fixedWork.on() ? .0 : jParams["MEASUREMENT_TIME"].get<double>();
 		mpi::cout << "Start thermalization at " << std::ctime(&(time = std::time(NULL))) << std::flush; 
 		mpi::cout = mpi::one;
-		mpi::cout << "We go for " << 60*thermalization_time << " seconds of MonteCarlo thermalization" << std::endl;
+		if(fixedWork.on()) 
+			mpi::cout << "We go for " << fixedWork.thermalizationSweeps() << " sweeps of MonteCarlo thermalization" << std::endl;
+		else 
+			mpi::cout << "We go for " << 60*thermalization_time << " seconds of MonteCarlo thermalization" << std::endl;
 		mpi::cout  = mpi::every;	
+		Intervals intervals(jParams);
+		Equilibration equilibration(jParams);
 		timer.start(60*thermalization_time);
+		adaptiveTimer.start(30*thermalization_time);
+		fixedWork.start();
 		for(; 1; ) { 
+			if(fixedWork.on() && thermalization_sweeps == fixedWork.thermalizationSweeps()) break;
+			
 			++thermalization_sweeps;
 			markovChain.doUpdate();
+			replicas.doUpdate();
+			fixedWork.add(markovChain.order());
+			
+			if(intervals.recording()) intervals.add(markovChain.order(), markovChain.sign());
 			
 			if(thermalization_sweeps % clean_every_sweep == 0) {
 				markovChain.cleanUpdate();
+				replicas.cleanUpdate();
+				if(intervals.recording()) intervals.drift(markovChain.drift(), clean_every_sweep);
 			}
 			
 			if(thermalization_sweeps % sample_every_sweep == 0)
 			{
-				if(timer.end()) break;
+				if(intervals.on() && !intervals.recording() && (fixedWork.on() ? 2*thermalization_sweeps >= fixedWork.thermalizationSweeps() : adaptiveTimer.end())) intervals.start();
+				if(equilibration.on() && equilibration.add(markovChain.order(), markovChain.sign(), markovChain.occupation())) break;
+				if(!fixedWork.on() && timer.end()) break;
 			}
 		}
+		fixedWork.stop();
+		equilibration.stop(timer.elapsed());
+		if(equilibration.on()) 
+			mpi::cout << (equilibration.equilibrated() ? "Equilibrated" : "Not equilibrated") << " after " << thermalization_sweeps << " sweeps" << std::endl;
+		if(intervals.on()) {
+			intervals.choose(sample_every_sweep, clean_every_sweep, simulation.jobspecs());
+			mpi::cout << "Sample every " << sample_every_sweep << " sweeps, clean every " << clean_every_sweep << " sweeps" << std::endl;
+		}
+		//The time left by the thermalization, measured after the intervals since choosing them waits for the other processors
+		double const spare_time = equilibration.on() ? std::max(.0, 60.*thermalization_time - timer.elapsed()) : .0;
 		mpi::cout << "Start measurements at " << std::ctime(&(time = std::time(NULL))) << std::flush;
-		mpi::cout = mpi::one;
-		mpi::cout << "We go for " << 60.*measurement_time << " seconds of MonteCarlo simulation" << std::endl;
+		mpi::cout = equilibration.on() && !fixedWork.on() ? mpi::every : mpi::one;
+		if(fixedWork.on()) 
+			mpi::cout << "We go for " << fixedWork.measurementSweeps() << " sweeps of MonteCarlo simulation" << std::endl;
+		else 
+			mpi::cout << "We go for " << 60.*measurement_time + spare_time << " seconds of MonteCarlo simulation" << std::endl;
 		mpi::cout = mpi::every;
-		timer.start(60.*measurement_time);
+		Termination termination(jParams);
+		timer.start(60.*measurement_time + spare_time);
+		fixedWork.start();
 		for(; 1; ) {
 			++measurement_sweeps;
 			
 			markovChain.doUpdate();
+			replicas.doUpdate();
+			fixedWork.add(markovChain.order());
 			
-			if(measurement_sweeps % clean_every_sweep == 0) 
+			if(measurement_sweeps % clean_every_sweep == 0) {
 				markovChain.cleanUpdate();
+				replicas.cleanUpdate();
+			}
 			
 			if(measurement_sweeps % sample_every_sweep == 0) {
 				markovChain.measure();
 				measurementsFromLastSample++;
 				if(measurementsFromLastSample % store_every_sample == 0) {
 					markovChain.store(simulation.meas(), store_every_sample);
-					if(timer.end()) break;					
+					bool const over = fixedWork.on() ? measurement_sweeps >= fixedWork.measurementSweeps() : timer.end();
+					if(termination.on() ? termination.done(measurementsFromLastSample, over, simulation.meas(), simulation.jobspecs()) : over) break;					
 				}
 			}
 		}
+		fixedWork.stop();
 		mpi::cout << "Start saving simulation at " << std::ctime(&(time = std::time(NULL))) << std::flush;
+		markovChain.saveProfile(simulation.jobspecs());
+		fixedWork.save(thermalization_sweeps, measurement_sweeps, measurementsFromLastSample, simulation.jobspecs());
+		equilibration.save(simulation.jobspecs());
+		replicas.save(simulation.jobspecs());
 		simulation.save(thermalization_sweeps, measurement_sweeps);
 	};
 };
@@ -0,0 +1,137 @@
+#ifndef __PROFILE
+#define __PROFILE
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include "nlohmann_json.hpp"
+#include "MPIUtilities.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+using json=nlohmann::json;
+
+namespace Prof {
+	/* Returns the time stamp counter of the processor, or the steady clock in nanoseconds where there is none */
+	inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	};
+
+	enum Move { Insert, Erase, SpinFlip, SiteFlip, Shift, NMove };
+	enum Section { DoUpdate, Measure, Store, CleanUpdate, TryFlip, NSection };
+
+	char const* const moveNames[NMove] = { "Insert", "Erase", "Spin Flip", "Site Flip", "Shift" };
+	char const* const sectionNames[NSection] = { "doUpdate", "measure", "store", "cleanUpdate", "tryFlip" };
+
+	/**
+	*
+	* struct Profile
+	*
+	* Description:
+	*   Counts the proposed and accepted updates per move type, the time spent in the main functions of the Markov chain and
+	*	the size of the bath matrix at every update. Switched on with the PROFILE parameter, it does nothing else than testing a flag otherwise.
+	*	The times are counted in cycles of the time stamp counter, the conversion to seconds is calibrated with the steady clock over the whole run.
+	*/
+	struct Profile {
+		explicit Profile(json const& jNumericalParams) :
+		on_(exists(jNumericalParams, "PROFILE") && jNumericalParams["PROFILE"].get<bool>()),
+		proposed_(NMove, 0), accepted_(NMove, 0), bounded_(NMove, 0), calls_(NSection, 0), cycles_(NSection, 0),
+		startCycles_(cycles()), start_(std::chrono::steady_clock::now()) {
+			if(on_) bathSize_.resize(64, 0);
+		};
+
+		bool on() const { return on_;};
+
+		void propose(Move move) { if(on_) ++proposed_[move];};
+		void accept(Move move) { if(on_) ++accepted_[move];};
+		void bound(Move move) { if(on_) ++bounded_[move];};
+		void bath(std::size_t size) {
+			if(on_) {
+				if(size >= bathSize_.size()) bathSize_.resize(2*size, 0);
+				++bathSize_[size];
+			}
+		};
+
+		/* Adds the cycles spent in a section from its construction to its destruction */
+		struct Scope {
+			Scope(Profile& profile, Section section) : profile_(profile), section_(section), start_(profile.on_ ? cycles() : 0) {};
+			~Scope() {
+				if(profile_.on_) {
+					++profile_.calls_[section_]; profile_.cycles_[section_] += cycles() - start_;
+				}
+			};
+		private:
+			Profile& profile_; Section const section_; uint64_t const start_;
+		};
+		/**
+		*
+		* void save(json& jJobSpecs)
+		*
+		* Parameters :	jJobSpecs : job specifications of the simulation
+		*
+		* Description:
+		*   Sums the counters over all processors and writes them in the field "Profile" of the job specifications, on the first processor.
+		*	Needs to be called by all processors.
+		*/
+		void save(json& jJobSpecs) {
+			if(!on_) return;
+
+			double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+			double const cyclesPerSecond = (cycles() - startCycles_)/seconds;
+
+			uint64_t size = bathSize_.size(), maxSize;
+			mpi::getMax(size, maxSize); bathSize_.resize(maxSize, 0);
+
+			std::vector<uint64_t> proposed(NMove), accepted(NMove), bounded(NMove), calls(NSection), cycles(NSection), bathSize(maxSize);
+			mpi::reduce(proposed_, proposed);
+			mpi::reduce(accepted_, accepted);
+			mpi::reduce(bounded_, bounded);
+			mpi::reduce(calls_, calls);
+			mpi::reduce(cycles_, cycles);
+			mpi::reduce(bathSize_, bathSize);
+
+			if(mpi::rank() == mpi::master) {
+				json jProfile;
+				for(int move = 0; move < NMove; ++move) {
+					json& jMove = jProfile["Moves"][moveNames[move]];
+					jMove["Proposed"] = proposed[move];
+					jMove["Accepted"] = accepted[move];
+					jMove["Acceptance Rate"] = proposed[move] ? accepted[move]/static_cast<double>(proposed[move]) : .0;
+					jMove["Rejected by Bound"] = bounded[move];
+				}
+				for(int section = 0; section < NSection; ++section) {
+					json& jSection = jProfile["Timers"][sectionNames[section]];
+					jSection["Calls"] = calls[section];
+					jSection["Cycles"] = cycles[section];
+					jSection["Seconds"] = cycles[section]/cyclesPerSecond;
+					jSection["Nanoseconds per Call"] = calls[section] ? 1.e9*cycles[section]/(cyclesPerSecond*calls[section]) : .0;
+				}
+
+				while(bathSize.size() > 1 && !bathSize.back()) bathSize.pop_back();
+				jProfile["Bath Size Histogram"] = bathSize;
+				jProfile["Cycles per Second"] = cyclesPerSecond;
+
+				jJobSpecs["Profile"] = jProfile;
+			}
+		};
+	private:
+		bool const on_;
+
+		std::vector<uint64_t> proposed_;
+		std::vector<uint64_t> accepted_;
+		std::vector<uint64_t> bounded_;     //Proposals rejected without the exact determinant ratio
+		std::vector<uint64_t> calls_;
+		std::vector<uint64_t> cycles_;
+		std::vector<uint64_t> bathSize_;    //Number of updates done with a bath matrix of each size
+
+		uint64_t const startCycles_;
+		std::chrono::steady_clock::time_point const start_;
+	};
+};
+
+#endif
@@ -129,8 +129,10 @@ namespace Tr {
 		lenght_(2, .0),
 		overlap_(.0),
 		toChi_(0),
+		chiValid_(false),
 		acc_(jNumericalParams),
 	    chiTemp_(acc_.Chi.size()){
+			toChi_ = new Ut::complex[acc_.Chi.size()];
 			operators_[0] = new Operators();
 			operators_[1] = new Operators();
 			
@@ -152,6 +154,7 @@ namespace Tr {
 		
 		Operator const& op() { return op_;};
 		Operator const& opDagg() { return opDagg_;};
+		Operator const& opShift() { return opShift_;};
 		
 		Operators const& operators(int spin) { return *operators_[spin];};
 		
@@ -163,7 +166,7 @@ namespace Tr {
 		};
 		/** 
 		* 
-		* double insert(int spin, Ut::UniformRngType& urng)
+		* double insert(int spin, Ut::UniformRng& urng)
 		* 
 		* Parameters :	spin : spin of the new vertex
 		*				urng : probabiliy distribution
@@ -175,7 +178,7 @@ namespace Tr {
 		* 	To do so, we choose what type of vertex and where to insert it.
 		*	We then insert it and compute the part of the acceptation rate relative to this site only and return it.
 		*/
-		double insert(int spin, Ut::UniformRngType& urng) {
+		double insert(int spin, Ut::UniformRng& urng) {
 			Operators& ops = *operators_[spin]; Operators& opsOther = *operators_[1 - spin]; 
 			
 			std::pair<Operators::iterator, bool> insertInfo;
@@ -225,7 +228,7 @@ namespace Tr {
 			lenght_[spin] += lenghtDiff_;
 			overlap_ += overlapDiff_;
 			
-			delete[] toChi_; toChi_ = 0;
+			chiValid_ = false;
 			
 			return op_ < opDagg_ ? 2*spin - 1 : 1 - 2*spin;
 		};
@@ -246,7 +249,7 @@ namespace Tr {
 		
 		/** 
 		* 
-		* double erase(int spin, Ut::UniformRngType& urng)
+		* double erase(int spin, Ut::UniformRng& urng)
 		* 
 		* Parameters :	spin : spin of the vertex to remove
 		*				urng : probabiliy distribution
@@ -258,7 +261,7 @@ namespace Tr {
 		* 	To do so, we choose what vertex we want to remove (accoring to urng).
 		*	We then compute the part of the acceptation rate relative to this site only and return it.
 		*/
-		double erase(int spin, Ut::UniformRngType& urng) {
+		double erase(int spin, Ut::UniformRng& urng) {
 			Operators const& ops = operators(spin); Operators const& opsOther = operators(1 - spin); 
 			
 			if(ops.size() != 2) {
@@ -315,7 +318,7 @@ namespace Tr {
 			operators_[spin]->erase(op_);
 			operators_[spin]->erase(opDagg_);
 			
-			delete[] toChi_; toChi_ = 0;
+			chiValid_ = false;
 			
 			return op_ < opDagg_ ? 2*spin - 1 : 1 - 2*spin;
 		};
@@ -324,6 +327,80 @@ namespace Tr {
 		};
 		/** 
 		* 
+		* double shift(int spin, Ut::UniformRng& urng)
+		* 
+		* Parameters :	spin : spin of the operator to move
+		*				urng : probabiliy distribution
+		*
+		* Return Value : the Metropolis Hastings acceptation rate for the site part 
+		*
+		* Description: 
+		*   In this function we want to move an operator between its two neighbours, which changes the lenght of the segment and of the antisegment on each side of it.
+		* 	The operator (op_) is chosen uniformly and its new time (opShift_) uniformly between the neighbours, so that the proposal is symmetric.
+		*	The new operator is inserted next to the old one and the changes of the lenght and of the overlap are computed on the interval between them only.
+		*/
+		double shift(int spin, Ut::UniformRng& urng) {
+			Operators& ops = *operators_[spin]; Operators const& opsOther = operators(1 - spin); 
+			
+			Operators::iterator it = ops.begin();
+			std::advance(it, static_cast<int>(ops.size()*urng()));
+			op_ = *it;
+			
+			Operators::iterator itPrev = it == ops.begin() ? ops.end() : it; --itPrev;
+			Operators::iterator itNext = it; if(++itNext == ops.end()) itNext = ops.begin();
+			
+			double const l = control(itNext->time() - itPrev->time());
+			
+			std::pair<Operators::iterator, bool> insertInfo;
+			do {
+				double time = itPrev->time() + urng()*l; 
+				insertInfo = ops.insert(Operator(op_.type(), time < beta_ ? time : time - beta_));
+			} while(!insertInfo.second);
+			opShift_ = *insertInfo.first;
+			
+			double const pos = control(op_.time() - itPrev->time());
+			double const newPos = control(opShift_.time() - itPrev->time());
+			
+			//Moving an annihilation operator (end of a segment) later increases the lenght, moving a creation operator later decreases it
+			int const sign = (newPos > pos ? 1 : -1)*(op_.type() ? -1 : 1);
+			Operator const& opLow = newPos > pos ? op_ : opShift_;
+			Operator const& opUp = newPos > pos ? opShift_ : op_;
+			
+			lenghtDiff_ = sign*std::abs(newPos - pos);
+			overlapDiff_ = sign*(opLow < opUp ? otherLenght(opsOther, opLow, opUp) : otherLenghtWO(opsOther, opLow, opUp));
+			shiftSign_ = opLow < opUp ? 1 : -1;
+			
+			if(opsOther.size()) return lenghtDiff_*mu_ - overlapDiff_*U_;
+			return logTr0(lenght_[spin] + lenghtDiff_) - logTr0(lenght_[spin]);
+		};
+		/** 
+		* 
+		* int acceptShift(int spin)
+		* 
+		* Parameters :	spin : spin of the moved operator
+		*
+		* Return Value : the sign change according to the ordering of the operators 
+		*
+		* Description:
+		*	It updates the overlap and occupation observables for the site and removes the operator at the old time.
+		*	The sign changes if the operator went across beta, since it then goes past all the other operators.
+		*/
+		int acceptShift(int spin) {
+			lenght_[spin] += lenghtDiff_;
+			overlap_ += overlapDiff_;
+			
+			operators_[spin]->erase(op_);
+			
+			chiValid_ = false;
+			
+			return shiftSign_;
+		};
+		
+		void rejectShift(int spin) {
+			operators_[spin]->erase(opShift_);
+		};
+		/** 
+		* 
 		* void flip()
 		*
 		* Description: 
@@ -332,19 +409,70 @@ namespace Tr {
 		void flip() {
 			std::swap(lenght_[0], lenght_[1]);
 			std::swap(operators_[0], operators_[1]);
+			
+			chiValid_ = false;
+		};
+		/** 
+		* 
+		* double occupation()
+		* 
+		* Return Value : the occupation of the site in the current configuration, the same estimator as the one of measure()
+		* 
+		* Description: 
+		*	Used to follow the thermalization (see MC::Equilibration), it does not change the accumulated observables.
+		*/
+		double occupation() {
+			if(operators(0).size() && operators(1).size()) return .5*(lenght_[0] + lenght_[1])/beta_;
+			
+			if(operators(0).size() || operators(1).size()) {
+				double const lenght = operators(0).size() ? lenght_[0] : lenght_[1];
+				double arg = mu_*beta_ - U_*lenght;
+				double exp = std::exp(-std::abs(arg));
+				double fact = (arg < .0 ? exp/(1. + exp) : 1./(1. + exp));
+				return (beta_*fact + lenght)/(2.*beta_);
+			}
+			
+			return (Tr00_1_ + Tr00_2_)/(Tr00_0_ + 2.*Tr00_1_ + Tr00_2_);
+		};
+		/** 
+		* 
+		* double logWeight(double mu)
+		* 
+		* Return Value : the log of the weight of the site in the current configuration, for the chemical potential mu
+		* 
+		* Description: 
+		*	The weight whose ratios the updates compute : a spin without operators is summed over the empty and the full line (see logTr0).
+		*	Used to exchange the configurations of replicas at different chemical potentials (see MC::Replicas).
+		*/
+		double logWeight(double mu) {
+			if(operators(0).size() && operators(1).size()) return (lenght_[0] + lenght_[1])*mu - overlap_*U_;
+			if(operators(0).size()) return logTr0(lenght_[0], mu);
+			if(operators(1).size()) return logTr0(lenght_[1], mu);
+			
+			double const shift = std::max(0., std::max(mu*beta_, 2.*mu*beta_ - U_*beta_));
+			return std::log(std::exp(-shift) + 2.*std::exp(mu*beta_ - shift) + std::exp(2.*mu*beta_ - U_*beta_ - shift)) + shift;
+		};
+		/* Exchanges the configuration with the trace of the same site in another replica (see MC::Replicas) */
+		void swapConfig(Trace& other) {
+			std::swap(operators_, other.operators_);
+			std::swap(lenght_, other.lenght_);
+			std::swap(overlap_, other.overlap_);
+			
+			chiValid_ = other.chiValid_ = false;
 		};
 		
 		/** 
 		* 
-		* measure(int sign) 
+		* measure(int sign, bool chi = true) 
 		* 
 		* Parameters :	sign : the sign of the system in order to compute sign*observables
+		*				chi : whether Chi at the finite frequencies is measured (see CHI_EVERY_SAMPLE), the returned array is only valid if it is
 		*
 		* Description: 
 		*   Computes all the observables for the site (Occupation, Double Occupation, Spin, Chi) 
 		* 
 		*/
-		std::valarray<Ut::complex>& measure(int sign) {
+		std::valarray<Ut::complex>& measure(int sign, bool chi = true) {
 			chiTemp_ = 0; //We reset the temporary Chiij to make sure we don't make mistakes later
 			acc_.k += sign*((operators(0).size() + operators(1).size())/2.);
 			
@@ -387,10 +515,11 @@ namespace Tr {
 				chiTemp_[0] += .0;
 			}
 			
-			if(acc_.Chi.size() > 1) {
+			if(chi && acc_.Chi.size() > 1) {
 				//In this part, we accumulate data for computing the spin susceptibility. 
-				if(!toChi_) {     //So wies aussieht haben wir hier glueck: keine fall unterschiedung fŸr 0 expansions ordnung nštig fuer finites omega					
-					toChi_ = new Ut::complex[acc_.Chi.size()];
+				if(!chiValid_) {     //So wies aussieht haben wir hier glueck: keine fall unterschiedung fŸr 0 expansions ordnung nštig fuer finites omega					
+					std::fill(toChi_, toChi_ + acc_.Chi.size(), Ut::complex(.0));
+					chiValid_ = true;
 					
 					Operators::const_iterator it0 = operators(0).begin();
 					Operators::const_iterator it1 = operators(1).begin();
@@ -424,12 +553,13 @@ namespace Tr {
 		};
 		
 		/** 
-		* void store(Ut::Measurements& measurements, int site, Meas& meas, int NMeas)
+		* void store(Ut::Measurements& measurements, int site, Meas& meas, int NMeas, int NChiMeas)
 		* 
 		* Parameters :	measurements : variable used to store the measurements, used for output
 		*				site : number of the site (because we don't store it in the Object)
 		*				meas : measurement object of the entire simulation
 		*				NMeas : Number of measurements done since the last time we stored some measurements
+		*				NChiMeas : Number of these measurements which included Chi at the finite frequencies
 		*
 		* Description: 
 		* 	Computes the mean over all measurements done since the last time we stored them.
@@ -437,12 +567,14 @@ namespace Tr {
 		*	Adds the site measurements to the measurements of the entire simulation
 		*	Resets the measurements for the next round of measurements
 		*/
-		void store(Ut::Measurements& measurements, int site, Meas& meas, int NMeas) {
+		void store(Ut::Measurements& measurements, int site, Meas& meas, int NMeas, int NChiMeas) {
 			acc_.k /= NMeas; 
 			acc_.N /= NMeas; 
 			acc_.Sz /= NMeas; 
 			acc_.D /= NMeas; 
-			acc_.Chi /= NMeas;
+			acc_.Chi[0] /= NMeas;
+			for(unsigned int n = 1; n < acc_.Chi.size(); ++n) 
+				acc_.Chi[n] /= NChiMeas;
 			
 			std::string s = std::to_string(site);
 			measurements["k_" + s] << acc_.k;
@@ -528,14 +660,17 @@ namespace Tr {
 		double overlap_;
 		
 		Ut::complex* toChi_;
+		bool chiValid_;        //toChi_ is only recomputed after a change of the operators
 		Meas acc_;		
 		std::valarray<Ut::complex> chiTemp_;
 
 		double lenghtDiff_;
 		double overlapDiff_;
+		int shiftSign_;
 		
 		Operator op_;
 		Operator opDagg_;
+		Operator opShift_;
 		
 		inline double control(double tau) {
 			return tau <= .0 ? tau + beta_ : tau;
@@ -609,10 +744,11 @@ namespace Tr {
 				return .0;
 		};
 		
-		double logTr0(double l) {
-			double const arg = beta_*mu_ - U_*l;
+		double logTr0(double l) { return logTr0(l, mu_);};
+		double logTr0(double l, double mu) {
+			double const arg = beta_*mu - U_*l;
 			double const exp = std::exp(-std::abs(arg));
-			return l*mu_ + std::log(1. + exp) + (arg > .0 ? arg : .0);
+			return l*mu + std::log(1. + exp) + (arg > .0 ? arg : .0);
 		};
 		
 		/** 
@@ -5,6 +5,7 @@
 #include <complex>
 #include <random>
 #include <valarray>
+#include <algorithm>
 #include "MPIUtilities.h"
 #include <iterator>
 #include "nlohmann_json.hpp"
@@ -22,6 +23,8 @@ extern "C" {
 	void   dcopy_(int const*, double const*, int const* , double*, int const*);
 	void   dgemv_(const char*, const int*, const int*, const double*, const double*, const int*, const double*, const int*, const double*, double*, const int*);
 	void   dgesv_(const int*, const int*, double*, const int*, int*, double*, const int*, int*);
+	void   dgetrf_(const int*, const int*, double*, const int*, int*, int*);
+	void   dgetri_(const int*, double*, const int*, int const*, double*, const int*, int*);
 	void   zaxpy_(const int*, const std::complex<double>*, const std::complex<double>*, const int*, std::complex<double>*, const int*);
 }
 
@@ -31,7 +34,159 @@ namespace Ut {
 	typedef std::complex<double> complex;
 	typedef std::mt19937 EngineType;
 	typedef std::uniform_real_distribution<double> UniformDistribution;
-	typedef std::function<double()> UniformRngType;
+	
+	/** 
+	* 
+	* struct UniformRng
+	* 
+	* Description: 
+	*   Uniform random numbers in [0,1) for the Markov chain. They are generated in blocks of blockSize and handed out one by one,
+	*	so that the call on the hot path is an inlined load and the generator loop runs uninterrupted.
+	*	The generator is chosen with the RNG parameter :
+	*		"mt19937" (default) : std::mt19937 seeded with SEED, the same numbers as std::uniform_real_distribution<double>(0, 1) over it
+	*		"xoshiro256++" : lanes interleaved xoshiro256++ streams, seeded with splitmix64 from SEED. The lanes are independent, so the compiler vectorizes the refill
+	*		For these two, the chains other than 0 (see MC::Replicas) are seeded with SEED and the chain number (std::seed_seq for std::mt19937)
+	*		"philox" : Philox4x32-10 counter based generator. The stream is keyed by the SEED of the input file (without the offset of the rank), the rank and the chain,
+	*			and the counter is the number of Philox calls. Its state is therefore a single number, which is saved with the configuration (see save() and load())
+	*/
+	struct UniformRng {
+		static int const blockSize = 256;
+		static int const lanes = 4;
+		
+		enum Generator { MT19937, Xoshiro, Philox };
+		
+		UniformRng(json const& jParams, int rank = 0, int chain = 0) :
+		generator_(MT19937),
+		mt_(engine(jParams["SEED"].get<double>(), chain)),
+		seed_(static_cast<uint64_t>(jParams["SEED"].get<double>() - rank)),
+		rank_(rank),
+		chain_(chain),
+		counter_(0),
+		pos_(blockSize) {
+			std::string const rng = exists(jParams, "RNG") ? jParams["RNG"].get<std::string>() : "mt19937";
+			
+			if(rng == "xoshiro256++") {
+				generator_ = Xoshiro;
+				uint64_t x = static_cast<uint64_t>(jParams["SEED"].get<double>()) + (static_cast<uint64_t>(chain) << 32);
+				for(int i = 0; i < 4; ++i)
+					for(int l = 0; l < lanes; ++l) s_[i][l] = splitmix64(x);
+			} else if(rng == "philox")
+				generator_ = Philox;
+			else if(rng != "mt19937") 
+				throw std::runtime_error("UniformRng: unknown RNG " + rng);
+		};
+		
+		double operator()() {
+			if(pos_ == blockSize) refill();
+			return block_[pos_++];
+		};
+		
+		Generator generator() const { return generator_;};
+		/** 
+		* 
+		* void save(json& jRng) const
+		* 
+		* Parameters :	jRng : output object
+		* 
+		* Description: 
+		*   Writes the key and the position in the stream of the philox generator, that is the counter of the current block and the position in the block.
+		*	Only meaningful for the philox generator, nothing is written for the others.
+		*/
+		void save(json& jRng) const {
+			if(generator_ != Philox) return;
+			
+			jRng["Generator"] = "philox";
+			jRng["Seed"] = seed_;
+			jRng["Rank"] = rank_;
+			jRng["Chain"] = chain_;
+			jRng["Counter"] = pos_ == blockSize ? counter_ : counter_ - blockSize/2;
+			jRng["Position"] = pos_ == blockSize ? 0 : pos_;
+		};
+		/** 
+		* 
+		* bool load(json const& jRng)
+		* 
+		* Parameters :	jRng : object written by save()
+		* 
+		* Return Value : true if the stream has been resumed
+		* 
+		* Description: 
+		*   Resumes the philox stream where save() left it, if it has the same key. Otherwise (for example with the new SEED of the next iteration) the stream starts at zero.
+		*/
+		bool load(json const& jRng) {
+			if(generator_ != Philox || !exists(jRng, "Generator") || jRng["Generator"].get<std::string>() != "philox") return false;
+			if(jRng["Seed"].get<uint64_t>() != seed_ || jRng["Rank"].get<int>() != rank_ || jRng["Chain"].get<int>() != chain_) return false;
+			
+			counter_ = jRng["Counter"];
+			refill();
+			pos_ = jRng["Position"];
+			return true;
+		};
+	private:
+		Generator generator_;
+		EngineType mt_;
+		uint64_t s_[4][lanes];
+		uint64_t const seed_;
+		int const rank_;
+		int const chain_;
+		uint64_t counter_;
+		int pos_;
+		double block_[blockSize];
+		
+		static EngineType engine(double seed, int chain) {
+			if(!chain) return EngineType(seed);
+			std::seed_seq seq{ static_cast<uint32_t>(seed), static_cast<uint32_t>(chain) };
+			return EngineType(seq);
+		};
+		
+		static uint64_t splitmix64(uint64_t& x) {
+			uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+			return z ^ (z >> 31);
+		};
+		
+		static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k));};
+		
+		static double toUniform(uint64_t x) { return (x >> 11)*(1./9007199254740992.);};    //53 bits over 2^53
+		
+		void refill() {
+			if(generator_ == Xoshiro) {
+				for(int i = 0; i < blockSize; i += lanes)
+					for(int l = 0; l < lanes; ++l) {
+						uint64_t const result = rotl(s_[0][l] + s_[3][l], 23) + s_[0][l];
+						uint64_t const t = s_[1][l] << 17;
+						s_[2][l] ^= s_[0][l]; s_[3][l] ^= s_[1][l];
+						s_[1][l] ^= s_[2][l]; s_[0][l] ^= s_[3][l];
+						s_[2][l] ^= t; s_[3][l] = rotl(s_[3][l], 45);
+						block_[i + l] = toUniform(result);
+					}
+			} else if(generator_ == Philox) {
+				//Every call maps the counter (iteration, rank, chain) and the key (seed) to four 32 bit words, that is two uniforms
+				for(int i = 0; i < blockSize/2; ++i) {
+					uint64_t const iteration = counter_ + i;
+					uint32_t c0 = static_cast<uint32_t>(iteration), c1 = static_cast<uint32_t>(iteration >> 32), c2 = rank_, c3 = chain_;
+					uint32_t k0 = static_cast<uint32_t>(seed_), k1 = static_cast<uint32_t>(seed_ >> 32);
+					for(int round = 0; round < 10; ++round) {
+						uint64_t const p0 = 0xD2511F53ULL*c0, p1 = 0xCD9E8D57ULL*c2;
+						c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0; c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+						c1 = static_cast<uint32_t>(p1); c3 = static_cast<uint32_t>(p0);
+						k0 += 0x9E3779B9U; k1 += 0xBB67AE85U;
+					}
+					block_[2*i] = toUniform((static_cast<uint64_t>(c0) << 32) | c1);
+					block_[2*i + 1] = toUniform((static_cast<uint64_t>(c2) << 32) | c3);
+				}
+				counter_ += blockSize/2;
+			} else
+				for(int i = 0; i < blockSize; ++i) {
+					//std::generate_canonical<double, 53> over the 32 bit engine, without the runtime logarithms of the library
+					double const x = mt_();
+					double const r = (x + mt_()*4294967296.)*(1./18446744073709551616.);
+					block_[i] = r < 1. ? r : std::nextafter(1., .0);
+				}
+			pos_ = 0;
+		};
+	};
 	
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------
 	
@@ -145,14 +300,29 @@ struct Observable {
 		{
 		  return sum_[0];
 		}
+		uint64_t size() const //Returns the number of entries of the observable
+		{
+		  return sum_.size() ? sum_[0].size() : 0;
+		}
+		/* Writes, for the binning levels l < levels, the number of bins, the sum of the measurements in these bins and the sum of the squared bin means of the entry n */
+		void binning(std::size_t n, std::size_t levels, double* out) const
+		{
+		  for(std::size_t l = 0; l < levels; ++l) {
+		    bool const filled = l < bin_entries_.size() && n < sum_[l].size();
+		    out[3*l] = filled ? bin_entries_[l] : .0;
+		    out[3*l + 1] = filled ? sum_[l][n] : .0;
+		    out[3*l + 2] = filled ? sum2_[l][n] : .0;
+		  }
+		}
 		/* End of helper functions */
 
 		/** 
 		* 
-		* void reduce(json& jMeas,json& jErrors)
+		* void reduce(std::valarray<double>& mean, std::valarray<double>& error, std::valarray<double>* bins = 0)
 		* 
-		* Parameters :	jEntry : storage point of the computed observables for printing in the ouput file
-		*				jMeas : storage point of the errors of the observables for printing in the ouput file
+		* Parameters :	mean : storage point of the computed observables for printing in the ouput file
+		*				error : storage point of the errors of the observables for printing in the ouput file
+		*				bins : if not null, storage point of the mean of every processor (processor after processor)
 		* 
 		* Description: 
 		*   Takes all the measured quantities from all running simulations in the MPIWorld together to a single value for the output file.
@@ -160,10 +330,11 @@ struct Observable {
 		*	We then add the entry to the output file. This is fairly easy to do here.
 		* 	Then we want to compute the error. This is a bit more difficult.
 		* 	We do a binning analysis using the conserved quantities computed in add on the single processors and also between them.
-		*	We then save the error in the jErrors object. 
+		*	We then save the error in the error array. 
 		* 	If you want to know more, the process is detailed in the function. 
+		*	The results are only available on the first processor.
 		*/
-		void reduce(json& jMean,json& jErrors) {
+		void reduce(std::valarray<double>& mean, std::valarray<double>& error, std::valarray<double>* bins = 0) {
 			
 			if(counter_ < 2)
 				throw std::runtime_error("Meas: Not enough measurements taken !");
@@ -178,7 +349,7 @@ struct Observable {
 			//Then we compute and save the mean only on the first processor
 			if(mpi::rank() == mpi::master) {
 				accBinningMean/=accCounter;
-				jMean = accBinningMean;
+				mean = accBinningMean;
 			}
 			
 			//Now we get the error. This operation is a bit trickier
@@ -228,13 +399,13 @@ struct Observable {
 				//We also need to gather all the data in a one dimensional vector and then put in a vector of valarray (needed for MPI_Gather)
 			std::valarray<double> allBinningSumsGather(static_cast<double>(0),mpi::number_of_workers()*binningSum.size());
 #ifdef HAVE_MPI
-			MPI_Gather(&binningSum[0],binningSum.size(),MPI_DOUBLE,&allBinningSumsGather[0],binningSum.size(), MPI_DOUBLE,0,MPI_COMM_WORLD);	
+			MPI_Gather(&binningSum[0],binningSum.size(),MPI_DOUBLE,&allBinningSumsGather[0],binningSum.size(), MPI_DOUBLE,0,mpi::group());	
 #else
 			allBinningSumsGather = binningSum;
 #endif
 			std::vector<uint64_t> allBinningCounts(mpi::number_of_workers(),0);
 #ifdef HAVE_MPI
-			MPI_Gather(&counter_,1,MPI_DOUBLE,&allBinningCounts[0],1, MPI_DOUBLE,0,MPI_COMM_WORLD);
+			MPI_Gather(&counter_,1,MPI_DOUBLE,&allBinningCounts[0],1, MPI_DOUBLE,0,mpi::group());
 #else
 			allBinningCounts[0] = counter_;
 #endif
@@ -245,6 +416,13 @@ struct Observable {
 				for(int i=0;i<mpi::number_of_workers();i++){
 					allBinningSums.push_back(allBinningSumsGather[std::slice(i*binningSum.size(),binningSum.size(),1)]);
 				}
+				//The means of the single processors are the bins of the binary output
+				if(bins) {
+					bins->resize(allBinningSumsGather.size());
+					for(int i=0;i<mpi::number_of_workers();i++){
+						(*bins)[std::slice(i*binningSum.size(),binningSum.size(),1)] = allBinningSums[i]/static_cast<double>(allBinningCounts[i]);
+					}
+				}
 				//We compute the statistics on the present arrays
 				while(allBinningSums.size() > 1){
 					uint64_t N_total = std::accumulate(allBinningCounts.begin(), allBinningCounts.end() , 0);
@@ -271,7 +449,7 @@ struct Observable {
 			}
 			if(mpi::rank() == mpi::master) {
 				/* In order to save the whole error graphs if you want to do some error analysis, use the following line */
-					//jErrors = accBinningErrs;
+					//error = accBinningErrs;
 				/* Else we need for each vector component, only the maximum error */
 					///*
 					std::valarray<double> binningErrs(accBinningMean.size());
@@ -281,7 +459,7 @@ struct Observable {
 					for(uint32_t i = 0 ; i<binningErrs.size();i++){
 						binningErrs[i] = static_cast<std::valarray<double> >(accBinningErrsValArray[std::slice(i,n_errs,binningErrs.size())]).max();
 					}
-					jErrors = binningErrs;
+					error = binningErrs;
 					//*/
 			}
 
@@ -300,6 +478,52 @@ struct Observable {
 	void operator<<(Observable& obs, std::valarray<double> const& val) { obs.add(val);};
 	
 	typedef std::map<std::string, Observable> Measurements;
+	/**
+	* 
+	* struct Autocorrelation
+	* 
+	* Description: 
+	*   Estimates the integrated autocorrelation time of a scalar time series on the fly, in memory logarithmic in its length.
+	*	The series is binned in blocks of 2^l entries. For uncorrelated blocks, 2^l*var(block means)/var(entries) = 1 + 2*tau, 
+	*	the estimate is the largest of these values over the levels with enough blocks for the variance to be meaningful.
+	*/
+	struct Autocorrelation {
+		void add(double x) {
+			for(std::size_t l = 0; ; ++l) {
+				if(l == count_.size()) {
+					sum_.push_back(.0); sum2_.push_back(.0); count_.push_back(0); pending_.push_back(.0); full_.push_back(false);
+				}
+				sum_[l] += x; sum2_[l] += x*x; ++count_[l];
+				
+				if(!full_[l]) { pending_[l] = x; full_[l] = true; return;}
+				x = .5*(pending_[l] + x); full_[l] = false;
+			}
+		};
+		
+		uint64_t size() const { return count_.size() ? count_[0] : 0;};
+		
+		double tau() const {
+			double const var0 = count_.size() ? variance(0) : .0;
+			if(var0 <= .0) return .0;
+			
+			double tau = .0;
+			for(std::size_t l = 1; l < count_.size(); ++l) 
+				if(count_[l] >= minBlocks) tau = std::max(tau, .5*(static_cast<double>(uint64_t(1) << l)*variance(l)/var0 - 1.));
+			return tau;
+		};
+	private:
+		static uint64_t const minBlocks = 64;
+		
+		std::vector<double> sum_, sum2_, pending_;
+		std::vector<uint64_t> count_;
+		std::vector<bool> full_;
+		
+		double variance(std::size_t l) const { 
+			double const mean = sum_[l]/count_[l];
+			return sum2_[l]/count_[l] - mean*mean;
+		};
+	};
+	
 	/** 
 	* 
 	* struct Simulation
@@ -309,10 +533,12 @@ struct Observable {
 	* 	It allows to : 
 	*		Store the input parameters
 	* 		Output all the parameters and measurements to the output file
+	*	Its collectives go over the group of processors of its parameter set (mpi::group()). In a batch of parameter sets (batch true), 
+	*	the files of the processors are prefixed with the name of the set, since the sets share the output folder.
 	* 
 	*/
 	struct Simulation {
-		Simulation(std::string inputFolder,std::string outputFolder,std::string name) : name_(name), outputFolder_(outputFolder) {
+		Simulation(std::string inputFolder,std::string outputFolder,std::string name, bool batch = false) : name_(name), outputFolder_(outputFolder), batch_(batch) {
 			{
 			    mpi::read_json(inputFolder + name_ + ".json", jParams_);
 			}
@@ -341,18 +567,32 @@ struct Observable {
 			uint64_t acc_measurement_sweeps;
 			
 #ifdef HAVE_MPI
-			MPI_Reduce(&thermalization_sweeps, mpi::rank() == mpi::master ? &acc_thermalization_sweeps : 0, 1, MPI_INT64_T, MPI_SUM, mpi::master, MPI_COMM_WORLD);
-			MPI_Reduce(&measurement_sweeps, mpi::rank() == mpi::master ? &acc_measurement_sweeps : 0, 1, MPI_INT64_T, MPI_SUM, mpi::master, MPI_COMM_WORLD);
+			MPI_Reduce(&thermalization_sweeps, mpi::rank() == mpi::master ? &acc_thermalization_sweeps : 0, 1, MPI_INT64_T, MPI_SUM, mpi::master, mpi::group());
+			MPI_Reduce(&measurement_sweeps, mpi::rank() == mpi::master ? &acc_measurement_sweeps : 0, 1, MPI_INT64_T, MPI_SUM, mpi::master, mpi::group());
 #else
 			acc_thermalization_sweeps = thermalization_sweeps;
 			acc_measurement_sweeps = measurement_sweeps;
 #endif
 						
+			bool const binary = exists(jParams_, "BINARY_MEASUREMENTS") && jParams_["BINARY_MEASUREMENTS"].get<bool>();
+			bool const binaryBins = binary && exists(jParams_, "BINARY_BINS") && jParams_["BINARY_BINS"].get<bool>();
+			
 			json jMeas;		
 			json jErrors;
-			for(std::map<std::string, Observable>::iterator it = measurements_.begin(); it != measurements_.end(); ++it) 
-				it->second.reduce(jMeas[it->first],jErrors[it->first]);
-
+			IO::BinaryMeasurements binaryMeas;
+			for(std::map<std::string, Observable>::iterator it = measurements_.begin(); it != measurements_.end(); ++it) {
+				std::valarray<double> mean, error, bins;
+				it->second.reduce(mean, error, binaryBins ? &bins : 0);
+				
+				if(mpi::rank() == mpi::master) {
+					if(binary) 
+						binaryMeas.add(it->first, mean, error, bins, binaryBins ? mpi::number_of_workers() : 0);
+					else {
+						jMeas[it->first] = mean;
+						jErrors[it->first] = error;
+					}
+				}
+			}
 				
 			if(mpi::rank() == mpi::master) {
 				jJobSpecs_["Thermalization Sweeps per Processor"] = acc_thermalization_sweeps/static_cast<double>(mpi::number_of_workers());
@@ -365,22 +605,30 @@ struct Observable {
 			    json temp;
 				temp["Parameters"] = jParams;
 				temp["Job Specifications"] = jJobSpecs_; 
-			    temp["Measurements"] = jMeas;
-			    temp["Errors"] = jErrors;
+				if(binary) {
+					//The json file is only an index of the binary file, that contains all the measured values
+					binaryMeas.write(outputFolder_ + name_ + ".meas.bin");
+					temp["Binary Measurements"]["file"] = name_ + ".meas.bin";
+					temp["Binary Measurements"]["observables"] = binaryMeas.index();
+				} else {
+					temp["Measurements"] = jMeas;
+					temp["Errors"] = jErrors;
+				}
 		
 				IO::writeJsonToFile(outputFolder_ + name_ + ".meas.json", temp);
 			}
-#ifdef HAVE_MPI
-			MPI_Barrier(MPI_COMM_WORLD);
-#endif
+			mpi::barrier();
 		}
 		std::string outputFolder()
 		{
 			return outputFolder_;
 		}
+		/* Prefix of the files of the processors (config and replay files) */
+		std::string prefix() const { return batch_ ? name_ + "_" : "";};
 	private:
 		std::string const name_;
 		std::string const outputFolder_;
+		bool const batch_;
 		json jParams_;
 		json jJobSpecs_;
 		Measurements measurements_;
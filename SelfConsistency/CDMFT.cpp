@@ -157,15 +157,15 @@ int main(int argc, char** argv)
         if(iteration) {
             /**********************************/
             /* We get the measurement results */
-            json jMeas = jInputFile["Measurements"];
-            /* And apply the sign */
-            divideAllBy(jMeas,"Sign");
+            json jMeas;
+            IO::readMeasurements(inputFolder, jInputFile, jMeas);
+            /* And apply the sign, except to the observables which are not multiplied by it */
+            divideAllBy(jMeas,"Sign",unsignedObservables);
             /**********************************/
 
             std::string hybFileName = jParams["HYB"];
-            json jHyb;
-            IO::readJsonFile(outputFolder + hybFileName,jHyb);
-            Hyb::accountForDifferentBeta(jHyb,beta);
+            Hyb::MatsubaraMap hybIn;
+            Hyb::read(outputFolder + hybFileName,hybIn,beta);
 
             //We have to read all the Hyb components into variables so take them from the jLink variable
             
@@ -175,9 +175,9 @@ int main(int argc, char** argv)
             {
                 if(p.first != "empty"){ //We don't read the empty component
                     if(NHyb == 0){
-                        NHyb = jHyb[p.first]["real"].size();
+                        NHyb = hybIn[p.first].data.size();
                         NGreen = jMeas["GreenI_" + p.first].size();
-                    }else if(NHyb != jHyb[p.first]["real"].size()){
+                    }else if(NHyb != hybIn[p.first].data.size()){
                         throw std::runtime_error(p.first + ": missmatch in entry length's of the hybridisation function.");
                     }else if(NGreen != jMeas["GreenI_" + p.first].size()){
                         throw std::runtime_error(p.first + ": missmatch in entry length's of the measured Green's function function.");
@@ -193,7 +193,7 @@ int main(int argc, char** argv)
                 for (auto &p : component_map)
                 {
                     if(p.first != "empty"){ //We don't read the empty component
-                        p.second = std::complex<double>(jHyb[p.first]["real"][n],jHyb[p.first]["imag"][n]);
+                        p.second = hybIn[p.first].data[n];
                     }
                 } 
                 //We initialize the hybridization matrix according to the Link file.
@@ -207,10 +207,7 @@ int main(int argc, char** argv)
             for (auto &p : component_map)
             {
                 if(p.first != "empty"){ //We don't read the empty component
-                    if(!exists(jHyb[p.first],"First Moment")){
-                        jHyb[p.first]["First Moment"]=0;
-                    }
-                    p.second = jHyb[p.first]["First Moment"];
+                    p.second = hybIn[p.first].firstMoment;
                 }
             } 
             for(std::size_t n = std::min(NHyb, NGreen); n < NGreen; ++n) {
@@ -330,7 +327,7 @@ int main(int argc, char** argv)
             for (auto &p : inverse_component_map)
             {
                 if(p.first != "empty"){
-                    jNextHyb[p.first]["First Moment"] = jHyb[p.first]["First Moment"];
+                    jNextHyb[p.first]["First Moment"] = hybIn[p.first].firstMoment;
                 }
             }
             /************************************************/
@@ -343,11 +340,10 @@ int main(int argc, char** argv)
             double const EGreen = jParams["EGreen"];
             unsigned int const NSelf = beta*EGreen/(2*M_PI) + 1;
             
-            json jSelf;
+            Hyb::MatsubaraMap selfIn;
             std::ifstream selfFile(dataFolder + "self0.json"); 
             if(selfFile.good()) {
-                selfFile >> jSelf;
-                Hyb::accountForDifferentBeta(jSelf,beta);
+                Hyb::read(dataFolder + "self0.json",selfIn,beta);
             }
 
             std::string dummy;
@@ -360,7 +356,7 @@ int main(int argc, char** argv)
                     for (auto &p : component_map)
                     {
                         if(p.first != "empty"){ //We don't read the empty component
-                            p.second = std::complex<double>(jSelf[p.first]["real"][n],jSelf[p.first]["imag"][n]);
+                            p.second = selfIn.at(p.first).data.at(n);
                         }
                     } 
                 }else{
@@ -77,9 +77,8 @@ int main(int argc, char** argv)
         }
         /*****************************************************************/
 
-        json jSelf;
-        IO::readJsonFile(dataFolder + "self" + std::to_string(iteration) + ".json",jSelf);
-        Hyb::accountForDifferentBeta(jSelf,beta);
+        Hyb::MatsubaraMap self;
+        Hyb::read(dataFolder + "self" + std::to_string(iteration) + ".json",self,beta);
 
 		std::ofstream pxgreenFile((dataFolder + "pxgreen" + std::to_string(iteration) + ".dat").c_str());
 		std::ofstream pygreenFile((dataFolder + "pygreen" + std::to_string(iteration) + ".dat").c_str());
@@ -99,7 +98,7 @@ int main(int argc, char** argv)
  			for (auto &p : component_map)
             {
                 if(p.first != "empty"){ //We don't read the empty component
-                    p.second = std::complex<double>(jSelf[p.first]["real"][n],jSelf[p.first]["imag"][n]);
+                    p.second = self.at(p.first).data.at(n);
                 }
             } 
 			/***********************************************/
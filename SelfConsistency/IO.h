@@ -3,6 +3,14 @@
 
 #include "nlohmann_json.hpp"
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "Patrick/Utilities.h"
 #include "Patrick/Plaquette/Plaquette.h"
 using json=nlohmann::json;
@@ -13,14 +21,18 @@ bool exists(const json& j, const std::string& key)
     return j.find(key) != j.end();
 }
 /********/
+/* Observables of the impurity solver which are not multiplied by the sign (SIGN_DIAGNOSTICS, see ImpuritySolver/README.md) */
+/* They must not be divided by Sign */
+const std::vector<std::string> unsignedObservables = {"SignTrace", "SignBath", "pKUnsigned", "SignChanges", "NegativeAccepts"};
+/********/
 /* Allows to divide all the elements in jObject by the value in jObject[key][0] */
-/* jObject[key] keeps its value */
+/* jObject[key] and the elements of the keys in skip keep their value */
 /* The jObject should be an object of arrays */
-void divideAllBy(json& jObject, const std::string key){
+void divideAllBy(json& jObject, const std::string key, std::vector<std::string> const& skip = std::vector<std::string>()){
 	const double denominator = jObject[key][0];
 	for (auto& el : jObject.items())
 	{
-		if(el.key() != key){
+		if(el.key() != key && std::find(skip.begin(), skip.end(), el.key()) == skip.end()){
 			/* Here el.value() is an array. We iterate over it to divide by the denominator variable*/
 			for(size_t i=0;i<el.value().size();i++){
 				double value = el.value()[i];
@@ -125,5 +137,91 @@ namespace IO{
 	    }
 	}
 	/****************************************************************************************/
+	/*************************************************************************************************************************/
+	/* Memory mapped reader of the binary measurement file written by the impurity solver when BINARY_MEASUREMENTS is set.  */
+	/* See BinaryMeasurements in ImpuritySolver/IO.h for the layout.                                                        */
+	/*************************************************************************************************************************/
+	struct MappedMeasurements {
+		MappedMeasurements(std::string const fileName) {
+			std::cout << "Mapping " << fileName << std::endl;
+			std::uint16_t const test = 1;
+			if(!*reinterpret_cast<char const*>(&test)) 
+				throw std::runtime_error("MappedMeasurements: the binary measurements are little-endian.");
+			
+			file_.fd = open(fileName.c_str(), O_RDONLY);
+			if(file_.fd < 0) throw std::runtime_error(fileName + " not found.");
+			
+			struct stat info;
+			if(fstat(file_.fd, &info) < 0 || info.st_size < 16) throw std::runtime_error(fileName + ": not a binary measurement file.");
+			
+			void* ptr = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, file_.fd, 0);
+			if(ptr == MAP_FAILED) throw std::runtime_error(fileName + ": mmap failed.");
+			map_.ptr = ptr; map_.size = info.st_size;
+			
+			char const* base = static_cast<char const*>(map_.ptr);
+			std::uint64_t headerSize;
+			std::memcpy(&headerSize, base + 8, sizeof(headerSize));
+			if(std::memcmp(base, "CTSEGBIN", 8) || headerSize > map_.size - 16) 
+				throw std::runtime_error(fileName + ": not a binary measurement file.");
+			
+			jObservables_ = json::parse(base + 16, base + 16 + headerSize).at("observables");
+			data_ = reinterpret_cast<double const*>(base + 16 + headerSize);
+			
+			//The arrays of every observable need to be within the file, a truncated file would otherwise be read past the mapping
+			std::uint64_t const nData = (map_.size - 16 - headerSize)/8;
+			for(auto const& el : jObservables_.items()) {
+				json const& jEntry = el.value();
+				std::uint64_t const size = jEntry["shape"][0];
+				bool ok = inside(jEntry["mean"], size, nData) && inside(jEntry["error"], size, nData);
+				if(exists(jEntry, "bins")) ok = ok && inside(jEntry["bins"], jEntry["bins shape"][0].get<std::uint64_t>()*jEntry["bins shape"][1].get<std::uint64_t>(), nData);
+				if(!ok) throw std::runtime_error(fileName + ": observable " + el.key() + " beyond the end of the file, it is truncated.");
+			}
+		};
+		
+		json const& observables() const { return jObservables_;};
+		std::size_t size(std::string const& name) const { return jObservables_.at(name)["shape"][0];};
+		double const* mean(std::string const& name) const { return data_ + jObservables_.at(name)["mean"].get<std::size_t>();};
+		double const* error(std::string const& name) const { return data_ + jObservables_.at(name)["error"].get<std::size_t>();};
+	private:
+		/* Whether the array [offset, offset + size) is within the nData doubles of the data */
+		static bool inside(std::uint64_t offset, std::uint64_t size, std::uint64_t nData) { return offset <= nData && size <= nData - offset;};
+		/* The file and its mapping are released by their destructors, also when the constructor throws */
+		struct File {
+			File() : fd(-1) {};
+			File(File const&) = delete;
+			File& operator=(File const&) = delete;
+			~File() { if(fd >= 0) close(fd);};
+			int fd;
+		};
+		struct Mapping {
+			Mapping() : ptr(0), size(0) {};
+			Mapping(Mapping const&) = delete;
+			Mapping& operator=(Mapping const&) = delete;
+			~Mapping() { if(ptr) munmap(ptr, size);};
+			void* ptr;
+			std::size_t size;
+		};
+		
+		File file_;
+		Mapping map_;
+		json jObservables_;
+		double const* data_;
+	};
+	/*****************************************************************************************************/
+	/* Gets the measurements of the output jInputFile of the impurity solver (read from inputFolder)    */
+	/* They are either in the json file itself or, if BINARY_MEASUREMENTS was set, in its binary file    */
+	/*****************************************************************************************************/
+	void readMeasurements(std::string const inputFolder, json const& jInputFile, json& jMeas){
+		if(exists(jInputFile,"Measurements")){
+			jMeas = jInputFile["Measurements"];
+		}else{
+			MappedMeasurements measurements(inputFolder + jInputFile["Binary Measurements"]["file"].get<std::string>());
+			for (auto& el : measurements.observables().items()){
+				double const* mean = measurements.mean(el.key());
+				jMeas[el.key()] = std::vector<double>(mean, mean + measurements.size(el.key()));
+			}
+		}
+	}
+	/*****************************************************************************************************/
 }
 #endif
@@ -8,51 +8,145 @@
 #include <map>
 #include <algorithm>
 #include <sstream>
+#include <fstream>
 #include "../nlohmann_json.hpp"
 #include "Utilities.h"
 using json=nlohmann::json;
 
 namespace Hyb {
-	/* When changing beta, the matsubara frequencies change, and the indices don't correspond to the same frequencies */
-	/* This function adapts the Matsubara data contained in (jComponentIn["real"] + i*jComponentIn["imag"]) */
-	/* 	from jComponentIn["beta"] to betaOut and returns the result */
-	/* The result conserves the other attributes of jComponentIn */
-	json read(json const& jComponentIn, double betaOut) {
-		json jComponentOut = jComponentIn;
-		double const betaIn = jComponentIn["beta"];
-		if(jComponentIn["real"].size() != jComponentIn["imag"].size()) 
-			throw std::runtime_error("Missmatch of real and imaginary array lengths.");
+	/** 
+	* 
+	* struct Matsubara
+	* 
+	* Description: 
+	*	Function on the fermionic Matsubara frequencies PI*(2*n+1)/beta, stored as one contiguous complex array,
+	*	together with the beta of the frequencies and the first and second moments of the high frequency expansion.
+	*	Missing moments are zero.
+	*/
+	struct Matsubara {
+		Matsubara() : beta(.0), firstMoment(.0), secondMoment(.0) {};
 		
-		jComponentOut["real"] = json::array();
-		jComponentOut["imag"] = json::array();
-		int n = 0;
-		for(int m = 1; m < static_cast<int>(jComponentIn["real"].size()); ++m) { 
-			double z0 = M_PI*(2*m - 1)/betaIn;
-			double z1 = M_PI*(2*m + 1)/betaIn;
+		double beta;
+		double firstMoment;
+		double secondMoment;
+		std::vector<Ut::complex> data;
+		
+		/** 
+		* 
+		* void setBeta(double betaOut)
+		* 
+		* Parameters :	betaOut : beta of the program in which the function needs to be transformed
+		*
+		* Description: 
+		*	As we are in Fourrier space with Matsubara frequencies PI*(2*m+1)/beta, we need to adapt the read data to the beta in the simulation.
+		*	This function computes function(iwn) from function(iwm) with wm = PI*(2*m+1)/beta, wn = PI*(2*n+1)/betaOut using linear interpolation.
+		*	The data is changed in place when betaOut <= beta, as every output frequency then only depends on input frequencies with the same or a larger index.
+		*/
+		void setBeta(double betaOut) {
+			if(betaOut == beta) return;
 			
-			Ut::complex h0(jComponentIn["real"][m - 1], jComponentIn["imag"][m - 1]);
-			Ut::complex h1(jComponentIn["real"][m], jComponentIn["imag"][m]);
+			std::vector<Ut::complex> temp; std::vector<Ut::complex> const* in = &data;
+			if(betaOut > beta) { temp.swap(data); in = &temp;}
 			
-			for(; (2*n + 1)/betaOut <= (2*m + 1)/betaIn; ++n) {
-				double w = M_PI*(2*n + 1)/betaOut;
-				std::complex<double> value = h0 + (h1 - h0)*(w - z0)/(z1 - z0);
-				jComponentOut["real"].push_back(value.real());
-				jComponentOut["imag"].push_back(value.imag());
+			double const betaIn = beta;
+			int n = 0;
+			for(int m = 1; m < static_cast<int>(in->size()); ++m) { 
+				double z0 = M_PI*(2*m - 1)/betaIn;
+				double z1 = M_PI*(2*m + 1)/betaIn;
+				
+				Ut::complex const h0 = (*in)[m - 1];
+				Ut::complex const h1 = (*in)[m];
+				
+				for(; (2*n + 1)/betaOut <= (2*m + 1)/betaIn; ++n) {
+					double w = M_PI*(2*n + 1)/betaOut;
+					Ut::complex value = h0 + (h1 - h0)*(w - z0)/(z1 - z0);
+					if(in == &data) data[n] = value; else data.push_back(value);
+				}
+			}
+			if(in == &data) data.resize(n);
+			beta = betaOut;
+		};
+	};
+	
+	typedef std::map<std::string, Matsubara> MatsubaraMap;
+	
+	/** 
+	* 
+	* struct MatsubaraReader
+	* 
+	* Description: 
+	*	SAX handler of the json parser, filling a MatsubaraMap in a single pass over the text (read more about the format in README.MD).
+	*	The "real" and "imag" arrays are directly appended to the complex array of the component, 
+	*	no intermediate json object is built.
+	*/
+	struct MatsubaraReader : nlohmann::json_sax<json> {
+		explicit MatsubaraReader(MatsubaraMap& functions) : functions_(functions), depth_(0), array_(false) {};
+		
+		bool start_object(std::size_t) {
+			if(++depth_ == 2) { 
+				current_ = Matsubara(); real_.clear(); imag_.clear();
+			}
+			return true;
+		};
+		bool end_object() {
+			if(depth_-- == 2) {
+				if(real_.size() != imag_.size()) 
+					throw std::runtime_error("Missmatch of real and imaginary array lengths.");
+				current_.data.resize(real_.size());
+				for(std::size_t m = 0; m < real_.size(); ++m) current_.data[m] = Ut::complex(real_[m], imag_[m]);
+				std::swap(functions_[component_], current_);
+			}
+			return true;
+		};
+		bool key(string_t& val) {
+			if(depth_ == 1) component_ = val; else if(depth_ == 2) key_ = val;
+			return true;
+		};
+		bool start_array(std::size_t) { array_ = depth_ == 2; return true;};
+		bool end_array() { array_ = false; return true;};
+		
+		bool number_integer(number_integer_t val) { return number(val);};
+		bool number_unsigned(number_unsigned_t val) { return number(val);};
+		bool number_float(number_float_t val, string_t const&) { return number(val);};
+		
+		bool null() { return true;};
+		bool boolean(bool) { return true;};
+		bool string(string_t&) { return true;};
+		bool binary(binary_t&) { return true;};
+		
+		bool parse_error(std::size_t, std::string const&, nlohmann::detail::exception const& ex) {
+			throw std::runtime_error(ex.what());
+		};
+	private:
+		MatsubaraMap& functions_;
+		
+		int depth_; bool array_;
+		std::string component_, key_;
+		Matsubara current_;
+		std::vector<double> real_, imag_;
+		
+		bool number(double val) {
+			if(depth_ != 2) return true;
+			if(array_) {
+				if(key_ == "real") real_.push_back(val); else if(key_ == "imag") imag_.push_back(val);
+			} else {
+				if(key_ == "beta") current_.beta = val;
+				else if(key_ == "First Moment") current_.firstMoment = val;
+				else if(key_ == "Second Moment") current_.secondMoment = val;
 			}
-		}
-		jComponentOut["beta"] = betaOut;
-		return jComponentOut;
+			return true;
+		};
 	};
 	/* Constructs the Hybridization Function in the imaginary time space */
 	struct Function {
-		Function(std::string name, json const& jNumericalParams, json const& jEntry) : 
+		Function(std::string name, json const& jNumericalParams, Matsubara const& entry) : 
 		beta_(jNumericalParams["beta"]), 
 		nItH_(jNumericalParams["EHyb"].get<double>()*jNumericalParams["EHyb"].get<double>()*beta_ + 1), 
 		hyb_(new double[nItH_ + 1]) {
 			std::cout << "Initialising data entry " << name << " ... ";
 			
-			double const FM = jEntry["First Moment"]; 
-			double const SM = jEntry["Second Moment"];
+			double const FM = entry.firstMoment; 
+			double const SM = entry.secondMoment;
 			
 			for(int i = 0; i < nItH_ + 1; ++i) {
 				double time = beta_*i/static_cast<double>(nItH_);
@@ -60,13 +154,12 @@ namespace Hyb {
 			}
 			   
 			/* Adapts the Hyb entry to the current beta_ */
-			json jHybWithRightBeta = read(jEntry, beta_);
-			json jReal = jHybWithRightBeta["real"];
-			json jImag = jHybWithRightBeta["imag"];
+			Matsubara hybWithRightBeta = entry; hybWithRightBeta.setBeta(beta_);
+			std::vector<Ut::complex> const& data = hybWithRightBeta.data;
 			/* Creates the imaginary time data */
-			for(unsigned int m = 0; m < jReal.size(); ++m) {
+			for(unsigned int m = 0; m < data.size(); ++m) {
 				Ut::complex z(.0, M_PI*(2*m + 1)/beta_);
-				Ut::complex value = std::complex<double>(jReal[m],jImag[m]) - FM/z - SM/(z*z);
+				Ut::complex value = data[m] - FM/z - SM/(z*z);
 				for(int i = 0; i < nItH_ + 1; ++i) {
 					double arg = M_PI*(2*m + 1)*i/static_cast<double>(nItH_); 
 					hyb_[i] += 2./beta_*(value.real()*std::cos(arg) + value.imag()*std::sin(arg));
@@ -91,15 +184,20 @@ namespace Hyb {
 	
 	//------------------------------------------------------------------------------------------------------------------------------------------
 	/**************************************************************************************************/
-	/*              This function adapts the Matsubara data file completely to betaOut                */
-	/*                          The jObject is just changed in place                                  */
+	/*        This function reads all the components of the Matsubara file fileName                  */
+	/*                    and adapts them completely to betaOut                                       */
 	/**************************************************************************************************/
-	void accountForDifferentBeta(json& jObject,double const betaOut){
-		json const& jTemp = jObject;
-		/* It changes the beta for all components in jObject */
-		for (auto& el : jTemp.items()){
-			std::cout << "Initialising data entry " << el.key() << " ... ";
-			jObject[el.key()] = read(jTemp[el.key()],betaOut);
+	void read(std::string fileName, MatsubaraMap& functions, double const betaOut){
+		std::cout << "Reading in " << fileName << std::endl;
+		std::ifstream file(fileName);
+		if(!file) throw std::runtime_error(fileName + " not found.");
+		
+		MatsubaraReader reader(functions);
+		json::sax_parse(file, &reader);
+		/* It changes the beta for all components */
+		for (auto& el : functions){
+			std::cout << "Initialising data entry " << el.first << " ... ";
+			el.second.setBeta(betaOut);
 			std::cout << "Ok" << std::endl;
 		} 
 	}
@@ -59,9 +59,8 @@ int main(int argc, char** argv)
         }
         /*****************************************************************/
 
-        json jSelf;
-        IO::readJsonFile(dataFolder + "self" + std::to_string(iteration) + ".json",jSelf);
-        Hyb::accountForDifferentBeta(jSelf,beta);
+        Hyb::MatsubaraMap self;
+        Hyb::read(dataFolder + "self" + std::to_string(iteration) + ".json",self,beta);
 
 		std::ofstream stiff(dataFolder + "stiffness.dat", std::ios::out | std::ios::app);
 		//
@@ -79,7 +78,7 @@ int main(int argc, char** argv)
  			for (auto &p : component_map)
             {
                 if(p.first != "empty"){ //We don't read the empty component
-                    p.second = std::complex<double>(jSelf[p.first]["real"][n],jSelf[p.first]["imag"][n]);
+                    p.second = self.at(p.first).data.at(n);
                 }
             } 
 			/***********************************************/